@@ -57,6 +57,18 @@ static void mach_sleep(struct machine_t * mach)
 {
 }
 
+static void mach_idle(struct machine_t * mach)
+{
+	__asm__ __volatile__ ("dsb sy" : : : "memory");
+	__asm__ __volatile__ ("wfe" : : : "memory");
+}
+
+static void mach_wakeup(struct machine_t * mach, int cpu)
+{
+	__asm__ __volatile__ ("dsb sy" : : : "memory");
+	__asm__ __volatile__ ("sev" : : : "memory");
+}
+
 static void mach_cleanup(struct machine_t * mach)
 {
 }
@@ -92,6 +104,8 @@ static struct machine_t x3399 = {
 	.shutdown	= mach_shutdown,
 	.reboot		= mach_reboot,
 	.sleep		= mach_sleep,
+	.idle		= mach_idle,
+	.wakeup		= mach_wakeup,
 	.cleanup	= mach_cleanup,
 	.logger		= mach_logger,
 	.uniqueid	= mach_uniqueid,
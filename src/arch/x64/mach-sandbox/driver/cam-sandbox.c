@@ -28,11 +28,14 @@
 
 #include <xboot.h>
 #include <camera/camera.h>
+#include <dma/dmapool.h>
 #include <sandbox.h>
 
 struct cam_sandbox_pdata_t {
 	char * path;
 	void * ctx;
+	struct dma_pool_t * pool;
+	void * buf;
 
 	enum video_format_t fmt;
 	int width;
@@ -47,7 +50,11 @@ static int cam_start(struct camera_t * cam, enum video_format_t fmt, int width,
 	pdat->width = width;
 	pdat->height = height;
 	if((pdat->ctx = sandbox_cam_start(pdat->path, (int *)&pdat->fmt, &pdat->width, &pdat->height)))
+	{
+		pdat->pool = dma_pool_create(pdat->width * pdat->height * 4, SZ_4K, 2);
+		pdat->buf = NULL;
 		return 1;
+	}
 	return 0;
 }
 
@@ -55,18 +62,46 @@ static int cam_stop(struct camera_t * cam)
 {
 	struct cam_sandbox_pdata_t * pdat = (struct cam_sandbox_pdata_t *)cam->priv;
 	if(pdat->ctx)
+	{
 		sandbox_cam_stop(pdat->ctx);
+		pdat->ctx = NULL;
+	}
+	if(pdat->pool)
+	{
+		if(pdat->buf)
+			dma_pool_free(pdat->pool, pdat->buf);
+		dma_pool_destroy(pdat->pool);
+		pdat->pool = NULL;
+		pdat->buf = NULL;
+	}
 	return 1;
 }
 
+/*
+ * The host buffer is queued back to the device as soon as it is dequeued,
+ * so each frame is copied into a dma pool buffer that stays valid until
+ * the next capture, and consumers can hand it on by dma_pool_to_phys.
+ */
 static int cam_capture(struct camera_t * cam, struct video_frame_t * frame)
 {
 	struct cam_sandbox_pdata_t * pdat = (struct cam_sandbox_pdata_t *)cam->priv;
+	void * buf;
+
 	if(pdat->ctx)
 	{
 		frame->buflen = sandbox_cam_capture(pdat->ctx, &frame->buf);
 		if(frame->buflen > 0)
 		{
+			if(pdat->pool && (frame->buflen <= pdat->pool->size) && (buf = dma_pool_alloc(pdat->pool)))
+			{
+				memcpy(buf, frame->buf, frame->buflen);
+				dma_cache_sync(buf, frame->buflen, DMA_TO_DEVICE);
+				if(pdat->buf)
+					dma_pool_free(pdat->pool, pdat->buf);
+				pdat->buf = buf;
+				frame->buf = buf;
+				frame->pool = pdat->pool;
+			}
 			frame->fmt = pdat->fmt;
 			frame->width = pdat->width;
 			frame->height = pdat->height;
@@ -141,6 +176,8 @@ static struct device_t * cam_sandbox_probe(struct driver_t * drv, struct dtnode_
 
 	pdat->path = strdup(path);
 	pdat->ctx = NULL;
+	pdat->pool = NULL;
+	pdat->buf = NULL;
 
 	cam->name = alloc_device_name(dt_read_name(n), dt_read_id(n));
 	cam->start = cam_start;
@@ -9,6 +9,7 @@ struct sandbox_timer_context_t {
 	struct sigevent sev;
 	struct itimerspec its;
 	timer_t tid;
+	volatile sig_atomic_t event;
 };
 static struct sandbox_timer_context_t tctx;
 
@@ -30,6 +31,7 @@ void sandbox_timer_init(void)
 	timer_create(CLOCK_MONOTONIC, &tctx.sev, &tctx.tid);
 	tctx.tcd.cb = NULL;
 	tctx.tcd.data = NULL;
+	tctx.event = 0;
 	tctx.its.it_value.tv_sec = 0;
 	tctx.its.it_value.tv_nsec = 0;
 	tctx.its.it_interval.tv_sec = 0;
@@ -50,6 +52,42 @@ void sandbox_timer_next(uint64_t time, void (*cb)(void *), void * data)
 	timer_settime(tctx.tid, 0, &tctx.its, NULL);
 }
 
+/*
+ * The timer signal is blocked while the wakeup event is checked, and only
+ * unblocked again inside pselect, so a wakeup raised by the signal handler
+ * after the idle check either is seen here or interrupts the wait.
+ */
+void sandbox_timer_wait(void)
+{
+	struct itimerspec its;
+	struct timespec ts;
+	sigset_t mask, omask;
+	uint64_t ns = 10000000ULL;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, &omask);
+	if(!tctx.event)
+	{
+		if(timer_gettime(tctx.tid, &its) == 0)
+		{
+			uint64_t t = its.it_value.tv_sec * 1000000000ULL + its.it_value.tv_nsec;
+			if((t > 0) && (t < ns))
+				ns = t;
+		}
+		ts.tv_sec = ns / 1000000000ULL;
+		ts.tv_nsec = ns % 1000000000ULL;
+		pselect(0, NULL, NULL, NULL, &ts, &omask);
+	}
+	tctx.event = 0;
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+}
+
+void sandbox_timer_wakeup(void)
+{
+	tctx.event = 1;
+}
+
 uint64_t sandbox_timer_count(void)
 {
 	struct timespec ts;
@@ -26,6 +26,7 @@ extern "C" {
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 #include <sys/reboot.h>
 #include <sys/timerfd.h>
 #include <sys/inotify.h>
@@ -57,6 +57,16 @@ static void mach_sleep(struct machine_t * mach)
 	sandbox_pm_sleep();
 }
 
+static void mach_idle(struct machine_t * mach)
+{
+	sandbox_timer_wait();
+}
+
+static void mach_wakeup(struct machine_t * mach, int cpu)
+{
+	sandbox_timer_wakeup();
+}
+
 static void mach_cleanup(struct machine_t * mach)
 {
 }
@@ -85,6 +95,8 @@ static struct machine_t sandbox = {
 	.shutdown	= mach_shutdown,
 	.reboot		= mach_reboot,
 	.sleep		= mach_sleep,
+	.idle		= mach_idle,
+	.wakeup		= mach_wakeup,
 	.cleanup	= mach_cleanup,
 	.logger		= mach_logger,
 	.uniqueid	= mach_uniqueid,
@@ -53,6 +53,12 @@ static void blk_romdisk_sync(struct block_t * blk)
 {
 }
 
+static void * blk_romdisk_map(struct block_t * blk, u64_t blkno, u64_t blkcnt)
+{
+	struct blk_romdisk_pdata_t * pdat = (struct blk_romdisk_pdata_t *)(blk->priv);
+	return (void *)(pdat->addr + block_offset(blk, blkno));
+}
+
 static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct blk_romdisk_pdata_t * pdat;
@@ -86,6 +92,7 @@ static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_romdisk_read;
 	blk->write = blk_romdisk_write;
 	blk->sync = blk_romdisk_sync;
+	blk->map = blk_romdisk_map;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
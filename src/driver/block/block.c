@@ -34,6 +34,498 @@ struct sub_block_pdata_t
 	struct block_t * pblk;
 };
 
+/*
+ * The buffer cache holds recently used blocks of every device, keyed by the
+ * whole device and block number, so partitions share the cache of their
+ * parent. Writes are kept dirty until block_sync or eviction, requests
+ * larger than a quarter of the cache go straight to the device.
+ */
+#define BCACHE_HASH_SIZE	(256)
+
+struct bcache_buf_t
+{
+	struct hlist_node node;
+	struct list_head entry;
+	struct block_t * blk;
+	u64_t blkno;
+	int dirty;
+	u8_t * data;
+};
+
+static struct hlist_head __bcache_hash[BCACHE_HASH_SIZE];
+static struct list_head __bcache_lru;
+static struct mutex_t __bcache_lock;
+static struct kmem_cache_t * __bcache_buf_cache;
+static size_t __bcache_bytes = 0;
+static size_t __bcache_dirty = 0;
+
+static u64_t sub_block_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt);
+
+static inline struct block_t * bcache_root(struct block_t * blk, u64_t * blkno)
+{
+	struct sub_block_pdata_t * pdat;
+
+	while(blk->read == sub_block_read)
+	{
+		pdat = (struct sub_block_pdata_t *)(blk->priv);
+		*blkno += pdat->blkno;
+		blk = pdat->pblk;
+	}
+	return blk;
+}
+
+static inline struct hlist_head * bcache_hash(struct block_t * blk, u64_t blkno)
+{
+	return &__bcache_hash[(((unsigned long)blk >> 4) ^ (unsigned long)blkno) & (BCACHE_HASH_SIZE - 1)];
+}
+
+static struct bcache_buf_t * bcache_lookup(struct block_t * blk, u64_t blkno)
+{
+	struct bcache_buf_t * b;
+
+	hlist_for_each_entry(b, bcache_hash(blk, blkno), node)
+	{
+		if((b->blk == blk) && (b->blkno == blkno))
+			return b;
+	}
+	return NULL;
+}
+
+static int bcache_writeback(struct bcache_buf_t * b)
+{
+	if(b->dirty)
+	{
+		if(b->blk->write(b->blk, b->data, b->blkno, 1) != 1)
+			return 0;
+		b->dirty = 0;
+		__bcache_dirty--;
+	}
+	return 1;
+}
+
+static void bcache_drop(struct bcache_buf_t * b)
+{
+	if(b->dirty)
+		__bcache_dirty--;
+	hlist_del(&b->node);
+	list_del(&b->entry);
+	__bcache_bytes -= block_size(b->blk);
+	free(b->data);
+	kmem_cache_free(__bcache_buf_cache, b);
+}
+
+static void bcache_shrink(size_t size)
+{
+	struct bcache_buf_t * b, * n;
+
+	list_for_each_entry_safe_reverse(b, n, &__bcache_lru, entry)
+	{
+		if(__bcache_bytes + size <= CONFIG_BLOCK_CACHE_SIZE)
+			break;
+		if(bcache_writeback(b))
+			bcache_drop(b);
+	}
+}
+
+static struct bcache_buf_t * bcache_insert(struct block_t * blk, u64_t blkno)
+{
+	struct bcache_buf_t * b;
+	u64_t blksz = block_size(blk);
+
+	bcache_shrink(blksz);
+	b = kmem_cache_alloc(__bcache_buf_cache);
+	if(!b)
+		return NULL;
+	b->data = malloc(blksz);
+	if(!b->data)
+	{
+		kmem_cache_free(__bcache_buf_cache, b);
+		return NULL;
+	}
+	b->blk = blk;
+	b->blkno = blkno;
+	b->dirty = 0;
+	init_hlist_node(&b->node);
+	hlist_add_head(&b->node, bcache_hash(blk, blkno));
+	list_add(&b->entry, &__bcache_lru);
+	__bcache_bytes += blksz;
+	return b;
+}
+
+static inline int bcache_bypass(struct block_t * blk, u64_t blkcnt)
+{
+	return (block_size(blk) * blkcnt > (CONFIG_BLOCK_CACHE_SIZE >> 2)) ? 1 : 0;
+}
+
+/*
+ * Read ahead of a sequential stream, a single transfer of up to count blocks
+ * starting at blkno, stopping at the first block already cached.
+ */
+static u64_t bcache_readahead(struct block_t * root, u64_t blkno, u64_t count)
+{
+	struct bcache_buf_t * b;
+	u64_t blksz = block_size(root);
+	u64_t i, n;
+	u8_t * tmp;
+
+	count = block_available_count(root, blkno, count);
+	for(i = 1; (i < count) && !bcache_lookup(root, blkno + i); i++);
+	count = i;
+	if(count <= 0)
+		return 0;
+
+	tmp = malloc(count * blksz);
+	if(!tmp)
+		return 0;
+	n = root->read(root, tmp, blkno, count);
+	for(i = 0; i < n; i++)
+	{
+		if((b = bcache_insert(root, blkno + i)))
+			memcpy(b->data, tmp + i * blksz, blksz);
+	}
+	free(tmp);
+	return n;
+}
+
+static inline u64_t bcache_readahead_window(struct block_t * root, u64_t blkno, u64_t blkcnt)
+{
+	u64_t max = CONFIG_BLOCK_READAHEAD_SIZE;
+
+	if(max > (CONFIG_BLOCK_CACHE_SIZE >> 2))
+		max = CONFIG_BLOCK_CACHE_SIZE >> 2;
+	max /= block_size(root);
+
+	if(blkno == root->ra_next)
+	{
+		if(root->ra_window > 0)
+			root->ra_window <<= 1;
+		else
+			root->ra_window = (blkcnt < 2) ? 4 : (blkcnt << 1);
+		if(root->ra_window > max)
+			root->ra_window = max;
+	}
+	else
+	{
+		root->ra_window = 0;
+	}
+	root->ra_next = blkno + blkcnt;
+	return root->ra_window;
+}
+
+static u64_t bcache_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_t * root;
+	struct bcache_buf_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t rblkno = blkno;
+	u64_t i = 0, j, n, window;
+	int bypass = bcache_bypass(blk, blkcnt);
+	int ahead = 0;
+
+	root = bcache_root(blk, &rblkno);
+	mutex_lock(&__bcache_lock);
+	window = bcache_readahead_window(root, rblkno, blkcnt);
+	while(i < blkcnt)
+	{
+		if((b = bcache_lookup(root, rblkno + i)))
+		{
+			memcpy(buf + i * blksz, b->data, blksz);
+			list_move(&b->entry, &__bcache_lru);
+			if(!ahead)
+				blk->hit++;
+			i++;
+			continue;
+		}
+		for(j = i + 1; (j < blkcnt) && !bcache_lookup(root, rblkno + j); j++);
+		blk->miss += j - i;
+		if(!bypass && !ahead && (j == blkcnt) && (window > j - i))
+		{
+			if(bcache_readahead(root, rblkno + i, window) <= 0)
+				break;
+			ahead = 1;
+			continue;
+		}
+		n = root->read(root, buf + i * blksz, rblkno + i, j - i);
+		if(!bypass)
+		{
+			for(; n > 0; n--, i++)
+			{
+				if((b = bcache_insert(root, rblkno + i)))
+					memcpy(b->data, buf + i * blksz, blksz);
+			}
+		}
+		else
+		{
+			i += n;
+		}
+		if(i < j)
+			break;
+	}
+	mutex_unlock(&__bcache_lock);
+
+	return i;
+}
+
+static u64_t bcache_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_t * root;
+	struct bcache_buf_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t rblkno = blkno;
+	u64_t i, n;
+
+	root = bcache_root(blk, &rblkno);
+	mutex_lock(&__bcache_lock);
+	if(bcache_bypass(blk, blkcnt))
+	{
+		n = root->write(root, buf, rblkno, blkcnt);
+		for(i = 0; i < blkcnt; i++)
+		{
+			if((b = bcache_lookup(root, rblkno + i)))
+			{
+				if(i < n)
+					bcache_drop(b);
+				else
+					bcache_writeback(b);
+			}
+		}
+	}
+	else
+	{
+		for(n = 0; n < blkcnt; n++)
+		{
+			if(!(b = bcache_lookup(root, rblkno + n)))
+			{
+				if(!(b = bcache_insert(root, rblkno + n)))
+				{
+					if(root->write(root, buf + n * blksz, rblkno + n, 1) != 1)
+						break;
+					continue;
+				}
+			}
+			memcpy(b->data, buf + n * blksz, blksz);
+			list_move(&b->entry, &__bcache_lru);
+			if(!b->dirty)
+			{
+				b->dirty = 1;
+				__bcache_dirty++;
+			}
+		}
+	}
+	mutex_unlock(&__bcache_lock);
+
+	return n;
+}
+
+/*
+ * Only the blocks inside the range of blk are written back or dropped, a
+ * partition shares the cache of its parent and must leave the blocks of its
+ * siblings alone.
+ */
+static void bcache_sync(struct block_t * blk, int drop)
+{
+	struct block_t * root;
+	struct bcache_buf_t * b, * n;
+	u64_t blkno = 0;
+	u64_t blkcnt = block_count(blk);
+
+	root = bcache_root(blk, &blkno);
+	mutex_lock(&__bcache_lock);
+	list_for_each_entry_safe_reverse(b, n, &__bcache_lru, entry)
+	{
+		if((b->blk == root) && (b->blkno >= blkno) && (b->blkno - blkno < blkcnt))
+		{
+			bcache_writeback(b);
+			if(drop)
+				bcache_drop(b);
+		}
+	}
+	mutex_unlock(&__bcache_lock);
+}
+
+/*
+ * Asynchronous requests are queued per device in submission order, a request
+ * that continues the one at the tail of the queue in the same direction is
+ * merged behind it. The worker task transfers each merged group in a single
+ * call, bouncing through a temporary buffer when the data buffers are not
+ * contiguous, and then completes the requests in order. The worker is
+ * created when the device is registered, so submitting never allocates and
+ * may be done from interrupt context. Every device and partition has one,
+ * the worker only copies and calls back, so it runs on a small stack.
+ */
+#define BIO_TASK_STACK_SIZE	(SZ_16K)
+
+static void bio_dispatch(struct block_t * blk, struct bio_t * bio)
+{
+	struct list_head merged;
+	struct bio_t * pos, * n;
+	u64_t blksz = block_size(blk);
+	u64_t count = bio->mcnt;
+	u64_t done, len;
+	u8_t * p = bio->buf;
+	u8_t * end = bio->buf + bio->blkcnt * blksz;
+	int bounce = 0;
+
+	list_for_each_entry(pos, &bio->merged, entry)
+	{
+		if(pos->buf != end)
+			bounce = 1;
+		end = pos->buf + pos->blkcnt * blksz;
+	}
+	if(bounce && !(p = malloc(count * blksz)))
+	{
+		p = bio->buf;
+		count = bio->blkcnt;
+		bounce = 0;
+	}
+
+	if(bounce && bio->write)
+	{
+		len = 0;
+		memcpy(p, bio->buf, bio->blkcnt * blksz);
+		len += bio->blkcnt * blksz;
+		list_for_each_entry(pos, &bio->merged, entry)
+		{
+			memcpy(p + len, pos->buf, pos->blkcnt * blksz);
+			len += pos->blkcnt * blksz;
+		}
+	}
+	if(bio->write)
+		done = bcache_write(blk, p, bio->blkno, count);
+	else
+		done = bcache_read(blk, p, bio->blkno, count);
+	if(bounce && !bio->write)
+	{
+		len = 0;
+		memcpy(bio->buf, p, bio->blkcnt * blksz);
+		len += bio->blkcnt * blksz;
+		list_for_each_entry(pos, &bio->merged, entry)
+		{
+			memcpy(pos->buf, p + len, pos->blkcnt * blksz);
+			len += pos->blkcnt * blksz;
+		}
+	}
+	if(bounce)
+		free(p);
+
+	init_list_head(&merged);
+	list_splice_init(&bio->merged, &merged);
+	bio->done = (done > bio->blkcnt) ? bio->blkcnt : done;
+	done -= bio->done;
+	if(bio->complete)
+		bio->complete(bio);
+	list_for_each_entry_safe(pos, n, &merged, entry)
+	{
+		list_del_init(&pos->entry);
+		if(count > bio->blkcnt)
+		{
+			pos->done = (done > pos->blkcnt) ? pos->blkcnt : done;
+			done -= pos->done;
+			if(pos->complete)
+				pos->complete(pos);
+		}
+		else
+		{
+			pos->mcnt = pos->blkcnt;
+			block_submit(blk, pos);
+		}
+	}
+}
+
+static void bio_task_func(struct task_t * task, void * data)
+{
+	struct block_t * blk = (struct block_t *)data;
+	struct list_head queue;
+	struct bio_t * bio, * n;
+	irq_flags_t flags;
+	int quit = 0;
+
+	while(!quit)
+	{
+		semaphore_down(&blk->bio_sem);
+		init_list_head(&queue);
+		spin_lock_irqsave(&blk->bio_lock, flags);
+		list_splice_init(&blk->bio_queue, &queue);
+		spin_unlock_irqrestore(&blk->bio_lock, flags);
+		list_for_each_entry_safe(bio, n, &queue, entry)
+		{
+			list_del_init(&bio->entry);
+			bio_dispatch(blk, bio);
+		}
+		spin_lock_irqsave(&blk->bio_lock, flags);
+		quit = blk->bio_exit && list_empty(&blk->bio_queue);
+		spin_unlock_irqrestore(&blk->bio_lock, flags);
+	}
+	blk->bio_task = NULL;
+	semaphore_up(&blk->bio_done);
+}
+
+void bio_init(struct bio_t * bio, int write, u64_t blkno, u64_t blkcnt, u8_t * buf, bio_complete_t complete, void * priv)
+{
+	if(bio)
+	{
+		init_list_head(&bio->entry);
+		init_list_head(&bio->merged);
+		bio->write = write ? 1 : 0;
+		bio->blkno = blkno;
+		bio->blkcnt = blkcnt;
+		bio->buf = buf;
+		bio->done = 0;
+		bio->mcnt = blkcnt;
+		bio->complete = complete;
+		bio->priv = priv;
+	}
+}
+
+int block_submit(struct block_t * blk, struct bio_t * bio)
+{
+	struct bio_t * tail;
+	irq_flags_t flags;
+
+	if(!blk || !bio || !bio->buf || (bio->blkcnt <= 0))
+		return 0;
+	if(block_available_count(blk, bio->blkno, bio->blkcnt) != bio->blkcnt)
+		return 0;
+
+	spin_lock_irqsave(&blk->bio_lock, flags);
+	if(!blk->bio_task || blk->bio_exit)
+	{
+		spin_unlock_irqrestore(&blk->bio_lock, flags);
+		return 0;
+	}
+	if(!list_empty(&blk->bio_queue))
+	{
+		tail = list_last_entry(&blk->bio_queue, struct bio_t, entry);
+		if((tail->write == bio->write) && (tail->blkno + tail->mcnt == bio->blkno) && (tail->mcnt + bio->blkcnt <= CONFIG_BLOCK_MERGE_COUNT))
+		{
+			list_add_tail(&bio->entry, &tail->merged);
+			tail->mcnt += bio->blkcnt;
+			spin_unlock_irqrestore(&blk->bio_lock, flags);
+			return 1;
+		}
+	}
+	list_add_tail(&bio->entry, &blk->bio_queue);
+	spin_unlock_irqrestore(&blk->bio_lock, flags);
+	semaphore_up(&blk->bio_sem);
+
+	return 1;
+}
+
+static ssize_t block_read_cache(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	u64_t blkno = 0;
+	char * p = buf;
+	int len = 0;
+
+	len += sprintf((char *)(p + len), " hit: %lld\r\n", blk->hit);
+	len += sprintf((char *)(p + len), " miss: %lld\r\n", blk->miss);
+	len += sprintf((char *)(p + len), " readahead: %lld\r\n", bcache_root(blk, &blkno)->ra_window);
+	len += sprintf((char *)(p + len), " cached: %ld\r\n", (long)__bcache_bytes);
+	len += sprintf((char *)(p + len), " dirty: %ld\r\n", (long)__bcache_dirty);
+	return len;
+}
+
 static ssize_t block_read_size(struct kobj_t * kobj, void * buf, size_t size)
 {
 	struct block_t * blk = (struct block_t *)kobj->priv;
@@ -73,6 +565,16 @@ static void sub_block_sync(struct block_t * blk)
 	pblk->sync(pblk);
 }
 
+static void * sub_block_map(struct block_t * blk, u64_t blkno, u64_t blkcnt)
+{
+	struct sub_block_pdata_t * pdat = (struct sub_block_pdata_t *)(blk->priv);
+	struct block_t * pblk = pdat->pblk;
+
+	if(!pblk->map)
+		return NULL;
+	return pblk->map(pblk, blkno + pdat->blkno, blkcnt);
+}
+
 struct block_t * search_block(const char * name)
 {
 	struct device_t * dev;
@@ -105,6 +607,17 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	kobj_add_regular(dev->kobj, "size", block_read_size, NULL, blk);
 	kobj_add_regular(dev->kobj, "count", block_read_count, NULL, blk);
 	kobj_add_regular(dev->kobj, "capacity", block_read_capacity, NULL, blk);
+	kobj_add_regular(dev->kobj, "cache", block_read_cache, NULL, blk);
+	blk->hit = 0;
+	blk->miss = 0;
+	blk->ra_next = 0;
+	blk->ra_window = 0;
+	init_list_head(&blk->bio_queue);
+	semaphore_init(&blk->bio_sem, 0);
+	semaphore_init(&blk->bio_done, 0);
+	spin_lock_init(&blk->bio_lock);
+	blk->bio_task = NULL;
+	blk->bio_exit = 0;
 
 	if(!register_device(dev))
 	{
@@ -113,6 +626,8 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 		free(dev);
 		return NULL;
 	}
+	if((blk->bio_task = task_create(NULL, blk->name, bio_task_func, blk, BIO_TASK_STACK_SIZE, 0)))
+		task_resume(blk->bio_task);
 	return dev;
 }
 
@@ -122,6 +637,13 @@ void unregister_block(struct block_t * blk)
 
 	if(blk && blk->name)
 	{
+		if(blk->bio_task)
+		{
+			blk->bio_exit = 1;
+			semaphore_up(&blk->bio_sem);
+			semaphore_down(&blk->bio_done);
+		}
+		bcache_sync(blk, 1);
 		dev = search_device(blk->name, DEVICE_TYPE_BLOCK);
 		if(dev && unregister_device(dev))
 		{
@@ -175,6 +697,7 @@ struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t
 	blk->read = sub_block_read;
 	blk->write = sub_block_write;
 	blk->sync = sub_block_sync;
+	blk->map = pblk->map ? sub_block_map : NULL;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, NULL)))
@@ -248,7 +771,7 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(bcache_read(blk, p, blkno, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -266,7 +789,7 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * blksz;
 
-		if(blk->read(blk, buf, blkno, tmp) != tmp)
+		if(bcache_read(blk, buf, blkno, tmp) != tmp)
 		{
 			free(p);
 			return ret;
@@ -282,7 +805,7 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(bcache_read(blk, p, blkno, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -331,7 +854,7 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(bcache_read(blk, p, blkno, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -339,7 +862,7 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 
 		memcpy((void *)(&p[tmp]), (const void *)buf, len);
 
-		if(blk->write(blk, p, blkno, 1) != 1)
+		if(bcache_write(blk, p, blkno, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -356,7 +879,7 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * blksz;
 
-		if(blk->write(blk, buf, blkno, tmp) != tmp)
+		if(bcache_write(blk, buf, blkno, tmp) != tmp)
 		{
 			free(p);
 			return ret;
@@ -372,7 +895,7 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(bcache_read(blk, p, blkno, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -380,7 +903,7 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 
 		memcpy((void *)(&p[0]), (const void *)buf, len);
 
-		if(blk->write(blk, p, blkno, 1) != 1)
+		if(bcache_write(blk, p, blkno, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -396,5 +919,48 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 void block_sync(struct block_t * blk)
 {
 	if(blk && blk->sync)
+	{
+		bcache_sync(blk, 0);
 		blk->sync(blk);
+	}
+}
+
+/*
+ * Return a pointer to count bytes at offset for devices backed by memory,
+ * such as romdisk and ramdisk, or NULL when the device can not be mapped.
+ * Dirty cached blocks are written back first so the mapping is current,
+ * it stays valid until the device is unregistered and must not be written.
+ */
+void * block_map(struct block_t * blk, u64_t offset, u64_t count)
+{
+	u64_t blkno, blksz, blkcnt;
+	u8_t * p;
+
+	if(!blk || !blk->map || !count)
+		return NULL;
+
+	blksz = block_size(blk);
+	if(!blksz || (offset >= block_capacity(blk)) || (count > block_capacity(blk) - offset))
+		return NULL;
+
+	blkno = offset / blksz;
+	blkcnt = (offset + count + blksz - 1) / blksz - blkno;
+	if(__bcache_dirty > 0)
+		bcache_sync(blk, 0);
+	p = blk->map(blk, blkno, blkcnt);
+	if(!p)
+		return NULL;
+	return p + (offset % blksz);
+}
+
+static __init void block_pure_init(void)
+{
+	int i;
+
+	for(i = 0; i < BCACHE_HASH_SIZE; i++)
+		init_hlist_head(&__bcache_hash[i]);
+	init_list_head(&__bcache_lru);
+	mutex_init(&__bcache_lock);
+	__bcache_buf_cache = kmem_cache_create("bcache", sizeof(struct bcache_buf_t), 0);
 }
+pure_initcall(block_pure_init);
@@ -113,6 +113,7 @@ int camera_capture(struct camera_t * cam, struct video_frame_t * frame, int time
 {
 	if(cam && cam->capture)
 	{
+		frame->pool = NULL;
 		if(timeout > 0)
 		{
 			ktime_t t = ktime_add_ms(ktime_get(), timeout);
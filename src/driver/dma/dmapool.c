@@ -58,3 +58,111 @@ static void __dma_cache_sync(void * addr, unsigned long size, int dir)
 }
 extern __typeof(__dma_cache_sync) dma_cache_sync __attribute__((weak, alias("__dma_cache_sync")));
 
+
+/*
+ * Fixed size dma buffer pool. All buffers are carved from one contiguous dma
+ * block, so their physical addresses are resolved once when the pool is
+ * created. The free list is a stack of buffer indexes in an atomic word, the
+ * upper half of which is a generation count that defeats aba on concurrent
+ * alloc and free.
+ */
+#define DMA_POOL_INDEX_MASK		(0xffff)
+#define DMA_POOL_GEN_SHIFT		(16)
+
+struct dma_pool_t * dma_pool_create(unsigned long size, unsigned long align, int count)
+{
+	struct dma_pool_t * pool;
+	int i;
+
+	if((size == 0) || (count <= 0) || (count >= DMA_POOL_INDEX_MASK))
+		return NULL;
+	if(align < SZ_4K)
+		align = SZ_4K;
+	if(align & (align - 1))
+		return NULL;
+
+	pool = malloc(sizeof(struct dma_pool_t));
+	if(!pool)
+		return NULL;
+
+	pool->size = size;
+	pool->stride = (size + align - 1) & ~(align - 1);
+	pool->count = count;
+	pool->next = malloc(sizeof(int) * count);
+	pool->mem = dma_alloc_noncoherent(pool->stride * count);
+	if(!pool->next || !pool->mem)
+	{
+		if(pool->mem)
+			dma_free_noncoherent(pool->mem);
+		if(pool->next)
+			free(pool->next);
+		free(pool);
+		return NULL;
+	}
+	pool->phys = virt_to_phys((virtual_addr_t)pool->mem);
+	for(i = 0; i < count; i++)
+		pool->next[i] = (i + 1 < count) ? i + 2 : 0;
+	atomic_set(&pool->head, 1);
+
+	return pool;
+}
+
+void dma_pool_destroy(struct dma_pool_t * pool)
+{
+	if(pool)
+	{
+		dma_free_noncoherent(pool->mem);
+		free(pool->next);
+		free(pool);
+	}
+}
+
+void * dma_pool_alloc(struct dma_pool_t * pool)
+{
+	unsigned int o, n;
+	int idx;
+
+	if(!pool)
+		return NULL;
+
+	do {
+		o = (unsigned int)atomic_get(&pool->head);
+		idx = (int)(o & DMA_POOL_INDEX_MASK) - 1;
+		if(idx < 0)
+			return NULL;
+		n = (((o >> DMA_POOL_GEN_SHIFT) + 1) << DMA_POOL_GEN_SHIFT) | (unsigned int)pool->next[idx];
+	} while(atomic_cmpxchg(&pool->head, (int)o, (int)n) != (int)o);
+
+	return (char *)pool->mem + pool->stride * idx;
+}
+
+void dma_pool_free(struct dma_pool_t * pool, void * addr)
+{
+	unsigned int o, n;
+	int idx;
+
+	if(!dma_pool_contains(pool, addr))
+		return;
+
+	idx = ((char *)addr - (char *)pool->mem) / pool->stride;
+	do {
+		o = (unsigned int)atomic_get(&pool->head);
+		pool->next[idx] = (int)(o & DMA_POOL_INDEX_MASK);
+		smp_wmb();
+		n = (((o >> DMA_POOL_GEN_SHIFT) + 1) << DMA_POOL_GEN_SHIFT) | (unsigned int)(idx + 1);
+	} while(atomic_cmpxchg(&pool->head, (int)o, (int)n) != (int)o);
+}
+
+physical_addr_t dma_pool_to_phys(struct dma_pool_t * pool, void * addr)
+{
+	if(!dma_pool_contains(pool, addr))
+		return 0;
+	return pool->phys + (physical_addr_t)((char *)addr - (char *)pool->mem);
+}
+
+int dma_pool_contains(struct dma_pool_t * pool, void * addr)
+{
+	if(pool && ((char *)addr >= (char *)pool->mem) && ((char *)addr < (char *)pool->mem + pool->stride * pool->count))
+		return 1;
+	return 0;
+}
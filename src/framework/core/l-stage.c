@@ -136,7 +136,7 @@ function M:loop()
 	self:addTimer(Timer.new(1 / 60, 0, function(t)
 		self:dispatch(Event.new("enter-frame"))
 		self:render(window)
-		collectgarbage("step")
+		xboot.gcstep()
 	end))
 
 	while self._running do
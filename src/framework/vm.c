@@ -165,61 +165,33 @@ static int luaopen_boot(lua_State * L)
 	return 0;
 }
 
-struct reader_data_t
-{
-	struct xfs_file_t * file;
-	char buffer[LUAL_BUFFERSIZE];
-};
-
-static const char * reader(lua_State * L, void * data, size_t * size)
-{
-	struct reader_data_t * rd = (struct reader_data_t *)data;
-	s64_t ret;
-
-	ret = xfs_read(rd->file, rd->buffer, LUAL_BUFFERSIZE);
-	if(ret < 0)
-	{
-		lua_error(L);
-		return NULL;
-	}
-
-	*size = (size_t)ret;
-	return rd->buffer;
-}
-
 static int l_loadfile(lua_State * L)
 {
 	struct xfs_context_t * ctx = ((struct vmctx_t *)luahelper_vmctx(L))->xfs;
 	const char * filename = luaL_optstring(L, 1, NULL);
-	struct reader_data_t * rd;
-
-	rd = malloc(sizeof(struct reader_data_t));
-	if(!rd)
-	{
-		lua_pushnil(L);
-		lua_pushfstring(L, "cannot malloc memory", filename);
-		return 2;
-	}
+	struct xfs_file_t * file;
+	const char * buf;
+	size_t len;
 
-	rd->file = xfs_open_read(ctx, filename);
-	if(!rd->file)
+	file = xfs_open_read(ctx, filename);
+	if(!file)
 	{
-		free(rd);
 		lua_pushnil(L);
 		lua_pushfstring(L, "cannot open %s", filename);
 		return 2;
 	}
 
-	if(lua_load(L, reader, rd, filename, NULL))
+	len = xfs_length(file);
+	buf = xfs_map(file);
+	if((!buf && (len > 0)) || luaL_loadbuffer(L, buf ? buf : "", buf ? len : 0, filename))
 	{
-		free(rd);
+		xfs_close(file);
 		lua_pushnil(L);
 		lua_pushfstring(L, "cannot read %s", filename);
 		return 2;
 	}
 
-	xfs_close(rd->file);
-	free(rd);
+	xfs_close(file);
 	return 1;
 }
 
@@ -325,6 +297,16 @@ static int l_xboot_keygen(lua_State * L)
 	return 1;
 }
 
+static int l_xboot_gcstep(lua_State * L)
+{
+	struct vmpool_t * pool = &((struct vmctx_t *)luahelper_vmctx(L))->pool;
+	int kb = pool->debt >> 10;
+
+	pool->debt = 0;
+	lua_pushboolean(L, lua_gc(L, LUA_GCSTEP, kb));
+	return 1;
+}
+
 static int pmain(lua_State * L)
 {
 	luaL_openlibs(L);
@@ -365,22 +347,168 @@ static int pmain(lua_State * L)
 	lua_setfield(L, -2, "uniqueid");
 	lua_pushcfunction(L, l_xboot_keygen);
 	lua_setfield(L, -2, "keygen");
+	lua_pushcfunction(L, l_xboot_gcstep);
+	lua_setfield(L, -2, "gcstep");
 
 	luaopen_boot(L);
 	return 0;
 }
 
+/*
+ * Every vm allocates from its own tlsf pool, built from chunks of the system
+ * heap. Small blocks are recycled through per size class free lists, and the
+ * whole pool is released at once when the vm exits.
+ */
+#define VMPOOL_CHUNK_SIZE		(SZ_1M)
+#define VMPOOL_CHUNK_HEADER		(sizeof(void *) * 4)
+
+static int vmpool_grow(struct vmpool_t * pool, size_t size)
+{
+	size_t csize = VMPOOL_CHUNK_SIZE;
+	void * chunk;
+
+	while(csize < size * 2 + SZ_4K)
+		csize <<= 1;
+	chunk = malloc(csize);
+	if(!chunk)
+		return 0;
+	if(!pool->mm)
+		pool->mm = mm_create((char *)chunk + VMPOOL_CHUNK_HEADER, csize - VMPOOL_CHUNK_HEADER);
+	else
+		mm_add_pool(pool->mm, (char *)chunk + VMPOOL_CHUNK_HEADER, csize - VMPOOL_CHUNK_HEADER);
+	*((void **)chunk) = pool->chunk;
+	pool->chunk = chunk;
+	return 1;
+}
+
+static void vmpool_drain(struct vmpool_t * pool)
+{
+	void * p;
+	int i;
+
+	for(i = 0; i < VMPOOL_CLASS_COUNT; i++)
+	{
+		while((p = pool->fl[i]))
+		{
+			pool->fl[i] = *((void **)p);
+			mm_free(pool->mm, p);
+		}
+	}
+}
+
+static inline int vmpool_class(size_t size)
+{
+	return (size > VMPOOL_CLASS_MAX) ? -1 : (int)((size - 1) >> VMPOOL_CLASS_SHIFT);
+}
+
+static void * vmpool_malloc(struct vmpool_t * pool, size_t size)
+{
+	int c = vmpool_class(size);
+	void * p;
+
+	if((c >= 0) && (p = pool->fl[c]))
+	{
+		pool->fl[c] = *((void **)p);
+		return p;
+	}
+	if(c >= 0)
+		size = (c + 1) << VMPOOL_CLASS_SHIFT;
+	if((p = mm_malloc(pool->mm, size)))
+		return p;
+	vmpool_drain(pool);
+	if((p = mm_malloc(pool->mm, size)))
+		return p;
+	if(vmpool_grow(pool, size))
+		return mm_malloc(pool->mm, size);
+	return NULL;
+}
+
+static void vmpool_free(struct vmpool_t * pool, void * ptr, size_t size)
+{
+	int c = vmpool_class(size);
+
+	if(c >= 0)
+	{
+		*((void **)ptr) = pool->fl[c];
+		pool->fl[c] = ptr;
+	}
+	else
+	{
+		mm_free(pool->mm, ptr);
+	}
+}
+
+static void * vmpool_realloc(struct vmpool_t * pool, void * ptr, size_t osize, size_t nsize)
+{
+	int oc = vmpool_class(osize);
+	int nc = vmpool_class(nsize);
+	void * p;
+
+	if((oc < 0) && (nc < 0))
+	{
+		if((p = mm_realloc(pool->mm, ptr, nsize)))
+			return p;
+	}
+	else if(oc == nc)
+	{
+		return ptr;
+	}
+	if((p = vmpool_malloc(pool, nsize)))
+	{
+		memcpy(p, ptr, (osize < nsize) ? osize : nsize);
+		vmpool_free(pool, ptr, osize);
+	}
+	return p;
+}
+
+static void vmpool_init(struct vmpool_t * pool)
+{
+	memset(pool, 0, sizeof(struct vmpool_t));
+}
+
+static void vmpool_exit(struct vmpool_t * pool)
+{
+	void * chunk;
+
+	while((chunk = pool->chunk))
+	{
+		pool->chunk = *((void **)chunk);
+		free(chunk);
+	}
+	pool->mm = NULL;
+}
+
 static void * l_alloc(void * ud, void * ptr, size_t osize, size_t nsize)
 {
+	struct vmpool_t * pool = &((struct vmctx_t *)ud)->pool;
+	void * p;
+
 	if(nsize == 0)
 	{
-		free(ptr);
+		if(ptr)
+		{
+			vmpool_free(pool, ptr, osize);
+			pool->used -= osize;
+		}
 		return NULL;
 	}
-	else
+	if(!ptr)
+		osize = 0;
+	if(!pool->mm && !vmpool_grow(pool, nsize))
+		return NULL;
+	p = ptr ? vmpool_realloc(pool, ptr, osize, nsize) : vmpool_malloc(pool, nsize);
+	if(p)
 	{
-		return realloc(ptr, nsize);
+		pool->used += nsize - osize;
+		if(nsize > osize)
+			pool->debt += nsize - osize;
 	}
+	return p;
+}
+
+static void l_hook(lua_State * L, lua_Debug * ar)
+{
+	task_preempt_point();
 }
 
 static int l_panic(lua_State *L)
@@ -393,7 +521,10 @@ static lua_State * l_newstate(void * ud)
 {
 	lua_State * L = lua_newstate(l_alloc, ud);
 	if(L)
+	{
 		lua_atpanic(L, &l_panic);
+		lua_sethook(L, &l_hook, LUA_MASKCOUNT, 1000);
+	}
 	return L;
 }
 
@@ -405,6 +536,7 @@ static struct vmctx_t * vmctx_alloc(const char * path, const char * fb, const ch
 	if(!ctx)
 		return NULL;
 
+	vmpool_init(&ctx->pool);
 	ctx->xfs = xfs_alloc(path, 1);
 	ctx->f = font_context_alloc();
 	ctx->w = window_alloc(fb, input);
@@ -421,6 +553,7 @@ static void vmctx_free(struct vmctx_t * ctx)
 	xfs_free(ctx->xfs);
 	font_context_free(ctx->f);
 	window_free(ctx->w);
+	vmpool_exit(&ctx->pool);
 	free(ctx);
 }
 
@@ -9,8 +9,22 @@ extern "C" {
 #include <graphic/font.h>
 #include <xboot/window.h>
 
+#define VMPOOL_CLASS_SHIFT		(4)
+#define VMPOOL_CLASS_COUNT		(16)
+#define VMPOOL_CLASS_MAX		(VMPOOL_CLASS_COUNT << VMPOOL_CLASS_SHIFT)
+
+struct vmpool_t
+{
+	void * mm;
+	void * chunk;
+	void * fl[VMPOOL_CLASS_COUNT];
+	size_t used;
+	size_t debt;
+};
+
 struct vmctx_t
 {
+	struct vmpool_t pool;
 	struct xfs_context_t * xfs;
 	struct font_context_t * f;
 	struct window_t * w;
@@ -7,6 +7,40 @@ extern "C" {
 
 #include <xboot.h>
 
+struct block_t;
+struct bio_t;
+
+typedef void (*bio_complete_t)(struct bio_t * bio);
+
+struct bio_t
+{
+	/* Queue entry and requests merged behind this one */
+	struct list_head entry;
+	struct list_head merged;
+
+	/* Write or read request */
+	int write;
+
+	/* The first block and the block counts */
+	u64_t blkno;
+	u64_t blkcnt;
+
+	/* Data buffer of blkcnt blocks */
+	u8_t * buf;
+
+	/* The block counts transferred, valid in completion */
+	u64_t done;
+
+	/* The block counts of this request and all merged ones */
+	u64_t mcnt;
+
+	/* Completion callback, called from the worker task */
+	bio_complete_t complete;
+
+	/* Private data */
+	void * priv;
+};
+
 struct block_t
 {
 	/* The block name */
@@ -27,6 +61,25 @@ struct block_t
 	/* Sync cache to block device */
 	void (*sync)(struct block_t * blk);
 
+	/* Map blocks into memory for direct reading, return NULL if not supported */
+	void * (*map)(struct block_t * blk, u64_t blkno, u64_t blkcnt);
+
+	/* Buffer cache hit and miss counts */
+	u64_t hit;
+	u64_t miss;
+
+	/* Sequential read-ahead state */
+	u64_t ra_next;
+	u64_t ra_window;
+
+	/* Asynchronous request queue and its worker task */
+	struct list_head bio_queue;
+	struct semaphore_t bio_sem;
+	struct semaphore_t bio_done;
+	spinlock_t bio_lock;
+	struct task_t * bio_task;
+	int bio_exit;
+
 	/* Private data */
 	void * priv;
 };
@@ -75,9 +128,13 @@ void unregister_block(struct block_t * blk);
 struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t length, const char * name);
 void unregister_sub_block(struct block_t * pblk);
 
+void bio_init(struct bio_t * bio, int write, u64_t blkno, u64_t blkcnt, u8_t * buf, bio_complete_t complete, void * priv);
+int block_submit(struct block_t * blk, struct bio_t * bio);
+
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 void block_sync(struct block_t * blk);
+void * block_map(struct block_t * blk, u64_t offset, u64_t count);
 
 #ifdef __cplusplus
 }
@@ -16,12 +16,15 @@ enum video_format_t {
 	VIDEO_FORMAT_MJPG	= 7,	/* motion jpeg */
 };
 
+struct dma_pool_t;
+
 struct video_frame_t {
 	enum video_format_t fmt;
 	int width;
 	int height;
 	int buflen;
 	void * buf;
+	struct dma_pool_t * pool;
 };
 
 void video_frame_to_argb(struct video_frame_t * frame, void * pixels);
@@ -5,18 +5,38 @@
 extern "C" {
 #endif
 
+#include <types.h>
+#include <atomic.h>
+
 enum {
 	DMA_BIDIRECTIONAL	= 0,
 	DMA_TO_DEVICE		= 1,
 	DMA_FROM_DEVICE		= 2,
 };
 
+struct dma_pool_t {
+	void * mem;
+	physical_addr_t phys;
+	unsigned long size;
+	unsigned long stride;
+	int count;
+	atomic_t head;
+	int * next;
+};
+
 void * dma_alloc_coherent(unsigned long size);
 void dma_free_coherent(void * addr);
 void * dma_alloc_noncoherent(unsigned long size);
 void dma_free_noncoherent(void * addr);
 void dma_cache_sync(void * addr, unsigned long size, int dir);
 
+struct dma_pool_t * dma_pool_create(unsigned long size, unsigned long align, int count);
+void dma_pool_destroy(struct dma_pool_t * pool);
+void * dma_pool_alloc(struct dma_pool_t * pool);
+void dma_pool_free(struct dma_pool_t * pool, void * addr);
+physical_addr_t dma_pool_to_phys(struct dma_pool_t * pool, void * addr);
+int dma_pool_contains(struct dma_pool_t * pool, void * addr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,8 @@ struct render_t;
  * The 32-bit quantities are stored native-endian, Pre-multiplied alpha is used.
  * That is, 50% transparent red is 0x80800000 not 0x80ff0000.
  */
+struct dma_pool_t;
+
 struct surface_t
 {
 	int width;
@@ -34,6 +36,7 @@ struct surface_t
 	struct render_t * r;
 	void * rctx;
 	void * priv;
+	struct dma_pool_t * pool;
 };
 
 enum render_type_t {
@@ -305,6 +308,7 @@ struct render_t * search_render(void);
 bool_t register_render(struct render_t * r);
 bool_t unregister_render(struct render_t * r);
 struct surface_t * surface_alloc(int width, int height, void * priv);
+struct surface_t * surface_alloc_from_dma_pool(struct dma_pool_t * pool, int width, int height, void * priv);
 struct surface_t * surface_alloc_from_xfs(struct xfs_context_t * ctx, const char * filename);
 struct surface_t * surface_alloc_qrcode(const char * txt, int pixsz);
 void surface_free(struct surface_t * s);
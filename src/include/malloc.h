@@ -17,6 +17,8 @@ void * mm_memalign(void * mm, size_t align, size_t size);
 void * mm_realloc(void * mm, void * ptr, size_t size);
 void mm_free(void * mm, void * ptr);
 void mm_info(void * mm, size_t * mused, size_t * mfree);
+void mm_walk(void * mm, void (*cb)(void * ptr, size_t size, int used, void * data), void * data);
+void mm_mapping(size_t size, int * fl, int * sl);
 
 void * malloc(size_t size);
 void * memalign(size_t align, size_t size);
@@ -24,6 +26,7 @@ void * realloc(void * ptr, size_t size);
 void * calloc(size_t nmemb, size_t size);
 void free(void * ptr);
 void meminfo(size_t * mused, size_t * mfree);
+void heap_walk(void (*cb)(void * ptr, size_t size, int used, void * caller, void * data), void * data);
 
 void do_init_mem(void);
 
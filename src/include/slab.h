@@ -0,0 +1,53 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <xconfigs.h>
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+
+struct kobj_t;
+
+struct kmem_magazine_t {
+	int count;
+	unsigned long hit;
+	unsigned long miss;
+	void * objs[CONFIG_SLAB_MAGAZINE_SIZE];
+};
+
+struct kmem_cache_t {
+	struct list_head entry;
+	char * name;
+	size_t size;
+	size_t offset;
+	size_t slabsz;
+	int nobjs;
+	int nslab;
+	int nempty;
+	int inuse;
+	struct list_head partial;
+	struct list_head full;
+	struct list_head empty;
+	struct kmem_magazine_t mag[CONFIG_MAX_SMP_CPUS];
+	struct kobj_t * kobj;
+	spinlock_t lock;
+};
+
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align);
+void kmem_cache_destroy(struct kmem_cache_t * cache);
+void * kmem_cache_alloc(struct kmem_cache_t * cache);
+void kmem_cache_free(struct kmem_cache_t * cache, void * obj);
+
+void * kmem_alloc(size_t size);
+void * kmem_realloc(void * ptr, size_t osize, size_t nsize);
+void kmem_free(void * ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SLAB_H__ */
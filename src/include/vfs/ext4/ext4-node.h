@@ -9,6 +9,13 @@ extern "C" {
 
 #define EXT4_NODE_LOOKUP_SIZE	(4)
 
+/* Resolved extent, logical to physical block run */
+struct ext4fs_extent_t {
+	u32_t lblk;
+	u32_t len;
+	u32_t pblk;		/* Zero for uninitialized extent */
+};
+
 /* Information for accessing a ext4fs file/directory */
 struct ext4fs_node_t {
 	/* Parent ext4fs control */
@@ -49,6 +56,14 @@ struct ext4fs_node_t {
 	u32_t dindir2_blkno;
 	bool_t dindir2_dirty;
 
+	/*
+	 * Extent cache, sorted by logical block
+	 * Loaded on demand. Must be freed in vput()
+	 */
+	struct ext4fs_extent_t * extents;
+	u32_t extent_count;
+	u32_t extent_max;
+
 	/* Child directory entry lookup table */
 	u32_t lookup_victim;
 	char lookup_name[EXT4_NODE_LOOKUP_SIZE][VFS_MAX_NAME];
@@ -61,6 +76,7 @@ int ext4fs_node_read_blk(struct ext4fs_node_t * node, u32_t blkno, u32_t blkoff,
 int ext4fs_node_write_blk(struct ext4fs_node_t * node, u32_t blkno, u32_t blkoff, u32_t blklen, char * buf);
 int ext4fs_node_sync(struct ext4fs_node_t * node);
 int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno);
+int ext4fs_node_read_blkrun(struct ext4fs_node_t * node, u32_t blkpos, u32_t maxcnt, u32_t * blkno, u32_t * blkcnt);
 int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blkno);
 u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf);
 u32_t ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf);
@@ -115,6 +115,7 @@ struct ext2_sblock_t {
 #define EXT3_FEAT_INCOMPAT_RECOVER		0x0004
 #define EXT3_FEAT_INCOMPAT_JOURNAL_DEV	0x0008	 
 #define EXT2_FEAT_INCOMPAT_META_BG		0x0010
+#define EXT4_FEAT_INCOMPAT_EXTENTS		0x0040 /* Files use extent trees */
 
 /* Feature Read-Only Compatibility */
 #define EXT2_FEAT_RO_COMPAT_SPARS_SUPER	0x0001 /* Sparse Superblock */
@@ -215,8 +216,38 @@ struct ext2_inode_t {
 #define EXT2_INDEX_FL					0x00001000 /* hash indexed directory */
 #define EXT2_IMAGIC_FL					0x00002000 /* AFS directory */
 #define EXT3_JOURNAL_DATA_FL			0x00004000 /* journal file data */
+#define EXT4_EXTENTS_FL					0x00080000 /* inode uses extents */
 #define EXT2_RESERVED_FL				0x80000000 /* reserved for ext2 library */
 
+/* The ext4 extent tree, rooted in the inode block array */
+#define EXT4_EXT_MAGIC					0xF30A
+#define EXT4_EXT_MAX_DEPTH				5
+#define EXT4_EXT_INIT_MAX_LEN			32768
+
+struct ext4_extent_header_t {
+	u16_t magic;
+	u16_t entries;		/* Number of valid entries */
+	u16_t max;			/* Capacity of store in entries */
+	u16_t depth;		/* Has tree real underlying blocks? */
+	u32_t generation;
+} __attribute__ ((packed));
+
+/* Index node entry */
+struct ext4_extent_idx_t {
+	u32_t block;		/* Index covers logical blocks from 'block' */
+	u32_t leaf_lo;		/* Pointer to the physical block of the next level */
+	u16_t leaf_hi;
+	u16_t unused;
+} __attribute__ ((packed));
+
+/* Leaf node entry */
+struct ext4_extent_t {
+	u32_t block;		/* First logical block extent covers */
+	u16_t len;			/* Number of blocks covered by extent */
+	u16_t start_hi;		/* High 16 bits of physical block */
+	u32_t start_lo;		/* Low 32 bits of physical block */
+} __attribute__ ((packed));
+
 /* The ext2 directory entry. */
 struct ext2_dirent_t {
 	u32_t inode;
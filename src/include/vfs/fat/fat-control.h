@@ -7,7 +7,19 @@ extern "C" {
 
 #include <vfs/fat/fat.h>
 
-#define FAT_TABLE_CACHE_SIZE	(32)
+#define FAT_TABLE_CACHE_SIZE	(CONFIG_FAT_TABLE_CACHE_SIZE)
+#define FAT_TABLE_CACHE_HASH	(64)
+
+/*
+ * One cached sector of the first FAT
+ */
+struct fatfs_fat_cache_t {
+	struct hlist_node node;
+	struct list_head lru;
+	u32_t sect_num;
+	bool_t dirty;
+	u8_t * buf;
+};
 
 /*
  * Information about a "mounted" FAT filesystem
@@ -42,11 +54,11 @@ struct fatfs_control_t {
 	/* FAT type */
 	enum fat_type_t type;
 
-	/* FAT sector cache */
+	/* FAT sector cache, hashed by sector number with lru replacement */
 	struct mutex_t fat_cache_lock;
-	u32_t fat_cache_victim;
-	bool_t fat_cache_dirty[FAT_TABLE_CACHE_SIZE];
-	u32_t fat_cache_num[FAT_TABLE_CACHE_SIZE];
+	struct hlist_head fat_cache_hash[FAT_TABLE_CACHE_HASH];
+	struct list_head fat_cache_lru;
+	struct fatfs_fat_cache_t fat_cache[FAT_TABLE_CACHE_SIZE];
 	u8_t * fat_cache_buf;
 };
 
@@ -7,6 +7,14 @@ extern "C" {
 
 #include <vfs/fat/fat.h>
 
+/*
+ * Run of physically contiguous clusters in a cluster chain
+ */
+struct fatfs_extent_t {
+	u32_t pos;
+	u32_t clust;
+	u32_t len;
+};
 
 /*
  * Information for accessing a FAT file/directory
@@ -29,6 +37,16 @@ struct fatfs_node_t {
 	u32_t cur_cluster;
 	u32_t cur_pos;
 
+	/*
+	 * Extent map of the cluster chain starting at map_first
+	 * Built on demand. Must be freed in fatfs_node_exit()
+	 */
+	struct fatfs_extent_t * map;
+	u32_t map_count;
+	u32_t map_max;
+	u32_t map_first;
+	u32_t map_clusters;
+
 	/* Cached clusters */
 	u8_t *cached_data;
 	u32_t cached_clust;
@@ -21,6 +21,7 @@ extern "C" {
 #define	VFS_MAX_NAME		(256)
 #define VFS_MAX_FD			(256)
 #define VFS_NODE_HASH_SIZE	(256)
+#define VFS_NODE_CACHE_SIZE	(64)
 
 #define O_RDONLY			(1 << 0)
 #define O_WRONLY			(1 << 1)
@@ -115,6 +116,8 @@ struct vfs_dirent_t {
 enum vfs_node_flag_t {
 	VNF_NONE,
 	VNF_ROOT,
+	VNF_NEGATIVE,
+	VNF_STALE,
 };
 
 enum vfs_node_type_t {
@@ -130,8 +133,11 @@ enum vfs_node_type_t {
 
 struct vfs_node_t {
 	struct list_head v_link;
+	struct list_head v_lru;
+	struct vfs_node_t * v_parent;
 	struct vfs_mount_t * v_mount;
 	atomic_t v_refcnt;
+	u32_t v_hash;
 	char v_path[VFS_MAX_PATH];
 	enum vfs_node_flag_t v_flags;
 	enum vfs_node_type_t v_type;
@@ -163,10 +169,15 @@ struct vfs_mount_t {
 	void * m_data;
 };
 
+enum {
+	FS_NOCACHE	= (0x1 << 0),
+};
+
 struct filesystem_t {
 	struct kobj_t * kobj;
 	struct list_head list;
 	const char * name;
+	u32_t flags;
 
 	int (*mount)(struct vfs_mount_t *, const char *);
 	int (*unmount)(struct vfs_mount_t *);
@@ -176,6 +187,7 @@ struct filesystem_t {
 
 	u64_t (*read)(struct vfs_node_t *, s64_t, void *, u64_t);
 	u64_t (*write)(struct vfs_node_t *, s64_t, void *, u64_t);
+	void * (*mmap)(struct vfs_node_t *, s64_t, u64_t);
 	int (*truncate)(struct vfs_node_t *, s64_t);
 	int (*sync)(struct vfs_node_t *);
 	int (*readdir)(struct vfs_node_t *, s64_t, struct vfs_dirent_t *);
@@ -205,6 +217,7 @@ int vfs_close(int fd);
 u64_t vfs_read(int fd, void * buf, u64_t len);
 u64_t vfs_write(int fd, void * buf, u64_t len);
 s64_t vfs_lseek(int fd, s64_t off, int whence);
+void * vfs_mmap(int fd, s64_t off, u64_t len);
 int vfs_fsync(int fd);
 int vfs_fchmod(int fd, u32_t mode);
 int vfs_fstat(int fd, struct vfs_stat_t * st);
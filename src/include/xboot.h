@@ -46,12 +46,14 @@ extern "C" {
 #include <ssize.h>
 #include <spring.h>
 #include <malloc.h>
+#include <slab.h>
 #include <charset.h>
 #include <version.h>
 #include <xboot/kref.h>
 #include <xboot/kobj.h>
 #include <xboot/ktime.h>
 #include <xboot/seqlock.h>
+#include <xboot/rawlock.h>
 #include <xboot/event.h>
 #include <xboot/profiler.h>
 #include <xboot/notifier.h>
@@ -61,7 +63,10 @@ extern "C" {
 #include <xboot/device.h>
 #include <xboot/driver.h>
 #include <xboot/task.h>
+#include <xboot/trace.h>
 #include <xboot/mutex.h>
+#include <xboot/rwlock.h>
+#include <xboot/semaphore.h>
 #include <xboot/channel.h>
 #include <xboot/window.h>
 #include <xboot/module.h>
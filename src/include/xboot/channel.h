@@ -6,21 +6,57 @@ extern "C" {
 #endif
 
 #include <types.h>
+#include <stdint.h>
 #include <list.h>
+#include <atomic.h>
 #include <spinlock.h>
 
+struct task_t;
+
+enum channel_mode_t {
+	CHANNEL_MODE_LOCK	= 0,
+	CHANNEL_MODE_SPSC	= 1,
+	CHANNEL_MODE_MPSC	= 2,
+};
+
+enum channel_event_t {
+	CHANNEL_EVENT_READ	= (1 << 0),
+	CHANNEL_EVENT_WRITE	= (1 << 1),
+};
+
+struct channel_waiter_t {
+	struct list_head list;
+	struct task_t * task;
+};
+
+struct channel_select_t {
+	struct channel_t * c;
+	int events;
+	int revents;
+	struct channel_waiter_t rw;
+	struct channel_waiter_t ww;
+};
+
 struct channel_t {
+	enum channel_mode_t mode;
 	unsigned char * buffer;
 	unsigned int size;
 	unsigned int in;
 	unsigned int out;
+	atomic_t head;
 	struct list_head swait;
 	struct list_head rwait;
 	spinlock_t lock;
 };
 
+struct channel_t * channel_alloc_mode(unsigned int size, enum channel_mode_t mode);
 struct channel_t * channel_alloc(unsigned int size);
 void channel_free(struct channel_t * c);
+unsigned int channel_reserve(struct channel_t * c, unsigned int len, unsigned char ** ptr);
+void channel_commit(struct channel_t * c, unsigned char * ptr, unsigned int len);
+unsigned int channel_peek(struct channel_t * c, unsigned char ** ptr);
+void channel_consume(struct channel_t * c, unsigned int len);
+int channel_select(struct channel_select_t * sel, int n, int64_t timeout);
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len);
 void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len);
 
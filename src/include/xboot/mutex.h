@@ -10,9 +10,14 @@ extern "C" {
 #include <atomic.h>
 #include <spinlock.h>
 
+struct task_t;
+
 struct mutex_t {
 	atomic_t atomic;
 	struct list_head mwait;
+	struct list_head held;
+	struct task_t * owner;
+	unsigned int contention;
 	spinlock_t lock;
 };
 
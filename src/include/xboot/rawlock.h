@@ -0,0 +1,46 @@
+#ifndef __RAWLOCK_H__
+#define __RAWLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <barrier.h>
+#include <atomic.h>
+#include <irqflags.h>
+
+/*
+ * A spinning lock built on atomic_cmpxchg, for data shared between cpus.
+ * The arch spinlock is only a flag on some ports, this one excludes other
+ * cpus everywhere. It never sleeps, so hold it only for short sections.
+ */
+typedef struct {
+	atomic_t lock;
+} rawlock_t;
+
+static inline void rawlock_init(rawlock_t * rl)
+{
+	atomic_set(&rl->lock, 0);
+}
+
+static inline void raw_lock(rawlock_t * rl)
+{
+	while(atomic_cmpxchg(&rl->lock, 0, 1) != 0)
+		smp_mb();
+	smp_mb();
+}
+
+static inline void raw_unlock(rawlock_t * rl)
+{
+	smp_mb();
+	atomic_set(&rl->lock, 0);
+}
+
+#define raw_lock_irqsave(rl, flags)			do { local_irq_save(flags); raw_lock(rl); } while(0)
+#define raw_unlock_irqrestore(rl, flags)	do { raw_unlock(rl); local_irq_restore(flags); } while(0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RAWLOCK_H__ */
@@ -0,0 +1,31 @@
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <xboot/rawlock.h>
+
+struct rwlock_t {
+	int readers;
+	int writer;
+	int wwaiting;
+	struct list_head rwait;
+	struct list_head wwait;
+	rawlock_t lock;
+};
+
+void rwlock_init(struct rwlock_t * rw);
+void rwlock_read_lock(struct rwlock_t * rw);
+void rwlock_read_unlock(struct rwlock_t * rw);
+void rwlock_write_lock(struct rwlock_t * rw);
+void rwlock_write_unlock(struct rwlock_t * rw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RWLOCK_H__ */
@@ -0,0 +1,27 @@
+#ifndef __SEMAPHORE_H__
+#define __SEMAPHORE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <xboot/rawlock.h>
+
+struct semaphore_t {
+	int count;
+	struct list_head swait;
+	rawlock_t lock;
+};
+
+void semaphore_init(struct semaphore_t * sem, int count);
+int semaphore_trydown(struct semaphore_t * sem);
+void semaphore_down(struct semaphore_t * sem);
+void semaphore_up(struct semaphore_t * sem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SEMAPHORE_H__ */
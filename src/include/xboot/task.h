@@ -13,6 +13,10 @@ extern "C" {
 #include <spinlock.h>
 #include <smp.h>
 #include <rbtree_augmented.h>
+#include <xboot/ktime.h>
+#include <time/timer.h>
+#include <xboot/trace.h>
+#include <xboot/rawlock.h>
 
 struct task_t;
 struct scheduler_t;
@@ -33,23 +37,30 @@ struct task_data_t {
 struct task_t {
 	struct rb_node node;
 	struct list_head list;
-	struct list_head slist;
-	struct list_head rlist;
 	struct list_head mlist;
+	struct list_head mheld;
 	struct scheduler_t * sched;
 	enum task_status_t status;
+	int parked;
+	int woken;
 	uint64_t start;
 	uint64_t time;
 	uint64_t vtime;
+	uint64_t wakeup;
+	uint64_t latency;
+	uint64_t nswitch;
 	char * name;
 	void * fctx;
 	void * stack;
 	size_t stksz;
 	int nice;
+	int bnice;
 	int weight;
 	uint32_t inv_weight;
 	task_func_t func;
 	void * data;
+	struct timer_t timer;
+	int preempt;
 	int __errno;
 };
 
@@ -57,9 +68,15 @@ struct scheduler_t {
 	struct rb_root_cached ready;
 	struct list_head suspend;
 	struct task_t * running;
+	struct task_t * idle;
 	uint64_t min_vtime;
 	uint64_t weight;
-	spinlock_t lock;
+	int nready;
+	int need_resched;
+	int idling;
+	int slicing;
+	struct timer_t timer;
+	rawlock_t lock;
 };
 
 extern struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
@@ -80,6 +97,12 @@ void task_renice(struct task_t * task, int nice);
 void task_suspend(struct task_t * task);
 void task_resume(struct task_t * task);
 void task_yield(void);
+void task_wait_until(ktime_t deadline);
+void task_sleep(uint64_t ns);
+size_t task_stack_usage(struct task_t * task);
+void task_preempt_disable(void);
+void task_preempt_enable(void);
+void task_preempt_point(void);
 
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data);
 void task_data_free(struct task_data_t * td);
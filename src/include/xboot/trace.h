@@ -0,0 +1,49 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <xconfigs.h>
+#include <types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct task_t;
+
+enum trace_type_t {
+	TRACE_TYPE_SWITCH	= 0,
+	TRACE_TYPE_WAKEUP	= 1,
+	TRACE_TYPE_SUSPEND	= 2,
+	TRACE_TYPE_YIELD	= 3,
+};
+
+struct trace_event_t {
+	uint64_t time;
+	enum trace_type_t type;
+	struct task_t * prev;
+	struct task_t * next;
+	char pname[16];
+	char nname[16];
+};
+
+extern int __trace_enable;
+void __trace_record(enum trace_type_t type, struct task_t * prev, struct task_t * next, uint64_t time);
+
+static inline void trace_record(enum trace_type_t type, struct task_t * prev, struct task_t * next, uint64_t time)
+{
+	if(unlikely(__trace_enable))
+		__trace_record(type, prev, next, time);
+}
+
+void trace_start(void);
+void trace_stop(void);
+void trace_clear(void);
+ssize_t trace_json(char * buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H__ */
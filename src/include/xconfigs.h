@@ -19,6 +19,54 @@ extern "C" {
 #define CONFIG_TASK_STACK_SIZE				(512 * 1024)
 #endif
 
+#if !defined(CONFIG_TASK_STACK_CACHE)
+#define CONFIG_TASK_STACK_CACHE				(4)
+#endif
+
+#if !defined(CONFIG_TASK_STACK_PROBE)
+#define CONFIG_TASK_STACK_PROBE				(0)
+#endif
+
+#if !defined(CONFIG_TASK_PREEMPT_GRANULARITY)
+#define CONFIG_TASK_PREEMPT_GRANULARITY		(4000000)
+#endif
+
+#if !defined(CONFIG_HEAP_PROFILE)
+#define CONFIG_HEAP_PROFILE					(0)
+#endif
+
+#if !defined(CONFIG_HEAP_LARGE_SIZE)
+#define CONFIG_HEAP_LARGE_SIZE				(256 * 1024)
+#endif
+
+#if !defined(CONFIG_SLAB_MAGAZINE_SIZE)
+#define CONFIG_SLAB_MAGAZINE_SIZE			(16)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_SIZE)
+#define CONFIG_BLOCK_CACHE_SIZE				(1024 * 1024)
+#endif
+
+#if !defined(CONFIG_BLOCK_READAHEAD_SIZE)
+#define CONFIG_BLOCK_READAHEAD_SIZE			(128 * 1024)
+#endif
+
+#if !defined(CONFIG_BLOCK_MERGE_COUNT)
+#define CONFIG_BLOCK_MERGE_COUNT			(256)
+#endif
+
+#if !defined(CONFIG_FAT_TABLE_CACHE_SIZE)
+#define CONFIG_FAT_TABLE_CACHE_SIZE			(128)
+#endif
+
+#if !defined(CONFIG_TRACE_RING_SIZE)
+#define CONFIG_TRACE_RING_SIZE				(1024)
+#endif
+
+#if !defined(CONFIG_MUTEX_SPIN_COUNT)
+#define CONFIG_MUTEX_SPIN_COUNT				(1000)
+#endif
+
 #if !defined(CONFIG_DRIVER_HASH_SIZE)
 #define CONFIG_DRIVER_HASH_SIZE				(521)
 #endif
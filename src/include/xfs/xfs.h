@@ -24,6 +24,8 @@ struct xfs_file_t {
 	struct xfs_context_t * ctx;
 	struct xfs_path_t * path;
 	void * fhandle;
+	void * map;
+	void * cache;
 };
 
 bool_t xfs_mount(struct xfs_context_t * ctx, const char * path, int writable);
@@ -41,6 +43,7 @@ s64_t xfs_write(struct xfs_file_t * file, void * buf, s64_t size);
 s64_t xfs_seek(struct xfs_file_t * file, s64_t offset);
 s64_t xfs_tell(struct xfs_file_t * file);
 s64_t xfs_length(struct xfs_file_t * file);
+void * xfs_map(struct xfs_file_t * file);
 void xfs_close(struct xfs_file_t * file);
 
 struct xfs_context_t * xfs_alloc(const char * path, int userdata);
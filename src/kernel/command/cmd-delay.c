@@ -41,7 +41,7 @@ static int do_delay(int argc, char ** argv)
 
 	if(argc > 1)
 		ms = strtoul(argv[1], NULL, 0);
-	mdelay(ms);
+	task_sleep((uint64_t)ms * 1000000ULL);
 
 	return 0;
 }
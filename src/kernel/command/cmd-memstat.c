@@ -0,0 +1,230 @@
+/*
+ * kernel/command/cmd-memstat.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <xboot.h>
+#include <command/command.h>
+
+#define MEMSTAT_MAX_FL		(64)
+#define MEMSTAT_MAX_SL		(32)
+#define MEMSTAT_MAX_SITE	(256)
+#define MEMSTAT_HASH_SIZE	(MEMSTAT_MAX_SITE * 2)
+
+struct memstat_bin_t {
+	int count;
+	size_t bytes;
+	size_t min;
+	size_t max;
+};
+
+struct memstat_site_t {
+	void * caller;
+	int count;
+	size_t bytes;
+};
+
+struct memstat_t {
+	struct memstat_bin_t bins[MEMSTAT_MAX_FL][MEMSTAT_MAX_SL];
+	struct memstat_site_t sites[MEMSTAT_MAX_SITE];
+	short hash[MEMSTAT_HASH_SIZE];
+	int nsite;
+	int ulost;
+	size_t used;
+	size_t free;
+	size_t largest;
+	int nused;
+	int nfree;
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    memstat [-n count]\r\n");
+}
+
+/*
+ * The walk runs with the arena lock held and interrupts masked, so call
+ * sites are found through an open addressed hash of site index plus one,
+ * kept at most half full, instead of a scan over all sites.
+ */
+static struct memstat_site_t * memstat_site(struct memstat_t * ms, void * caller)
+{
+	struct memstat_site_t * site;
+	unsigned int h = ((unsigned long)caller >> 2) * 2654435761U;
+	int i;
+
+	for(h &= MEMSTAT_HASH_SIZE - 1; ms->hash[h] != 0; h = (h + 1) & (MEMSTAT_HASH_SIZE - 1))
+	{
+		site = &ms->sites[ms->hash[h] - 1];
+		if(site->caller == caller)
+			return site;
+	}
+	if(ms->nsite >= MEMSTAT_MAX_SITE)
+		return NULL;
+	i = ms->nsite++;
+	ms->hash[h] = i + 1;
+	site = &ms->sites[i];
+	site->caller = caller;
+	site->count = 0;
+	site->bytes = 0;
+	return site;
+}
+
+static void memstat_block(void * ptr, size_t size, int used, void * caller, void * data)
+{
+	struct memstat_t * ms = (struct memstat_t *)data;
+	struct memstat_site_t * site;
+	struct memstat_bin_t * bin;
+	int fl, sl;
+
+	if(used)
+	{
+		ms->used += size;
+		ms->nused++;
+		if(!caller)
+			return;
+		if(!(site = memstat_site(ms, caller)))
+		{
+			ms->ulost++;
+			return;
+		}
+		site->count++;
+		site->bytes += size;
+	}
+	else
+	{
+		ms->free += size;
+		ms->nfree++;
+		if(size > ms->largest)
+			ms->largest = size;
+		mm_mapping(size, &fl, &sl);
+		if((fl >= 0) && (fl < MEMSTAT_MAX_FL) && (sl >= 0) && (sl < MEMSTAT_MAX_SL))
+		{
+			bin = &ms->bins[fl][sl];
+			if((bin->count == 0) || (size < bin->min))
+				bin->min = size;
+			if(size > bin->max)
+				bin->max = size;
+			bin->count++;
+			bin->bytes += size;
+		}
+	}
+}
+
+static int memstat_site_cmp(const void * a, const void * b)
+{
+	const struct memstat_site_t * sa = a;
+	const struct memstat_site_t * sb = b;
+
+	if(sa->bytes < sb->bytes)
+		return 1;
+	else if(sa->bytes > sb->bytes)
+		return -1;
+	return 0;
+}
+
+static int do_memstat(int argc, char ** argv)
+{
+	struct memstat_t * ms;
+	struct memstat_bin_t * bin;
+	int n = 32;
+	int fl, sl, i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-n") && (argc > i + 1))
+		{
+			n = strtol(argv[i + 1], NULL, 0);
+			i++;
+		}
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+
+	ms = calloc(1, sizeof(struct memstat_t));
+	if(!ms)
+		return -1;
+	heap_walk(memstat_block, ms);
+
+	printf(" used: %ld bytes in %d blocks\r\n", (long)ms->used, ms->nused);
+	printf(" free: %ld bytes in %d blocks\r\n", (long)ms->free, ms->nfree);
+	printf(" largest free block: %ld bytes\r\n", (long)ms->largest);
+	if(ms->free > 0)
+		printf(" fragmentation: %ld%%\r\n", (long)(100 - (ms->largest * 100) / ms->free));
+
+	printf("\r\n %-4s %-4s %-8s %-12s %s\r\n", "FL", "SL", "BLOCKS", "BYTES", "RANGE");
+	for(fl = 0; fl < MEMSTAT_MAX_FL; fl++)
+	{
+		for(sl = 0; sl < MEMSTAT_MAX_SL; sl++)
+		{
+			bin = &ms->bins[fl][sl];
+			if(bin->count > 0)
+				printf(" %-4d %-4d %-8d %-12ld %ld - %ld\r\n", fl, sl, bin->count, (long)bin->bytes, (long)bin->min, (long)bin->max);
+		}
+	}
+
+	if(ms->nsite > 0)
+	{
+		qsort(ms->sites, ms->nsite, sizeof(struct memstat_site_t), memstat_site_cmp);
+		printf("\r\n %-18s %-8s %s\r\n", "CALLER", "BLOCKS", "BYTES");
+		for(i = 0; (i < ms->nsite) && (i < n); i++)
+			printf(" %-18p %-8d %ld\r\n", ms->sites[i].caller, ms->sites[i].count, (long)ms->sites[i].bytes);
+		if(ms->ulost > 0)
+			printf(" (%d blocks from untracked call sites)\r\n", ms->ulost);
+	}
+	else if(!CONFIG_HEAP_PROFILE)
+	{
+		printf("\r\n call site tracking needs CONFIG_HEAP_PROFILE\r\n");
+	}
+	free(ms);
+
+	return 0;
+}
+
+static struct command_t cmd_memstat = {
+	.name	= "memstat",
+	.desc	= "heap usage by call site and free block histogram",
+	.usage	= usage,
+	.exec	= do_memstat,
+};
+
+static __init void memstat_cmd_init(void)
+{
+	register_command(&cmd_memstat);
+}
+
+static __exit void memstat_cmd_exit(void)
+{
+	unregister_command(&cmd_memstat);
+}
+
+command_initcall(memstat_cmd_init);
+command_exitcall(memstat_cmd_exit);
@@ -0,0 +1,155 @@
+/*
+ * kernel/command/cmd-trace.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <command/command.h>
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    trace <start|stop|clear|stat>\r\n");
+	printf("    trace dump [file]\r\n");
+}
+
+static void trace_stat(void)
+{
+	struct scheduler_t * sched;
+	struct task_t * pos, * n;
+	struct slist_t * sl, * e;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		sl = slist_alloc();
+		sched = &__sched[i];
+
+		pos = sched->running;
+		if(pos)
+			slist_add(sl, pos, "%s", pos->name ? pos->name : "");
+		rbtree_postorder_for_each_entry_safe(pos, n, &sched->ready.rb_root, node)
+		{
+			slist_add(sl, pos, "%s", pos->name ? pos->name : "");
+		}
+		list_for_each_entry_safe(pos, n, &sched->suspend, list)
+		{
+			slist_add(sl, pos, "%s", pos->name ? pos->name : "");
+		}
+		slist_sort(sl);
+
+		printf("CPU%d:\r\n", i);
+		slist_for_each_entry(e, sl)
+		{
+			pos = (struct task_t *)e->priv;
+			printf(" %12lld %20lld %12lld %s\r\n", pos->nswitch, pos->time, (pos->nswitch > 0) ? pos->latency / pos->nswitch : 0, e->key);
+		}
+		slist_free(sl);
+	}
+}
+
+static int trace_dump(const char * file)
+{
+	char fpath[VFS_MAX_PATH];
+	size_t size = CONFIG_MAX_SMP_CPUS * CONFIG_TRACE_RING_SIZE * 256 + 64;
+	ssize_t len;
+	char * buf;
+	int fd;
+
+	buf = malloc(size);
+	if(!buf)
+		return -1;
+	len = trace_json(buf, size);
+	if(file)
+	{
+		if(shell_realpath(file, fpath) < 0)
+		{
+			free(buf);
+			return -1;
+		}
+		fd = vfs_open(fpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0)
+		{
+			free(buf);
+			return -1;
+		}
+		vfs_write(fd, buf, len);
+		vfs_close(fd);
+	}
+	else
+	{
+		buf[len] = '\0';
+		printf("%s\r\n", buf);
+	}
+	free(buf);
+	return 0;
+}
+
+static int do_trace(int argc, char ** argv)
+{
+	if(argc < 2)
+	{
+		usage();
+		return -1;
+	}
+
+	if(!strcmp(argv[1], "start"))
+		trace_start();
+	else if(!strcmp(argv[1], "stop"))
+		trace_stop();
+	else if(!strcmp(argv[1], "clear"))
+		trace_clear();
+	else if(!strcmp(argv[1], "stat"))
+		trace_stat();
+	else if(!strcmp(argv[1], "dump"))
+		return trace_dump((argc > 2) ? argv[2] : NULL);
+	else
+	{
+		usage();
+		return -1;
+	}
+	return 0;
+}
+
+static struct command_t cmd_trace = {
+	.name	= "trace",
+	.desc	= "scheduler tracing and accounting",
+	.usage	= usage,
+	.exec	= do_trace,
+};
+
+static __init void trace_cmd_init(void)
+{
+	register_command(&cmd_trace);
+}
+
+static __exit void trace_cmd_exit(void)
+{
+	unregister_command(&cmd_trace);
+}
+
+command_initcall(trace_cmd_init);
+command_exitcall(trace_cmd_exit);
@@ -29,7 +29,7 @@
 #include <xboot.h>
 #include <xboot/channel.h>
 
-struct channel_t * channel_alloc(unsigned int size)
+struct channel_t * channel_alloc_mode(unsigned int size, enum channel_mode_t mode)
 {
 	struct channel_t * c;
 
@@ -46,9 +46,11 @@ struct channel_t * channel_alloc(unsigned int size)
 		free(c);
 		return NULL;
 	}
+	c->mode = mode;
 	c->size = size;
 	c->in = 0;
 	c->out = 0;
+	atomic_set(&c->head, 0);
 	init_list_head(&c->swait);
 	init_list_head(&c->rwait);
 	spin_lock_init(&c->lock);
@@ -56,6 +58,11 @@ struct channel_t * channel_alloc(unsigned int size)
 	return c;
 }
 
+struct channel_t * channel_alloc(unsigned int size)
+{
+	return channel_alloc_mode(size, CHANNEL_MODE_LOCK);
+}
+
 void channel_free(struct channel_t * c)
 {
 	if(c)
@@ -65,38 +72,49 @@ void channel_free(struct channel_t * c)
 	}
 }
 
-static inline int channel_isempty(struct channel_t * c)
+static inline unsigned int channel_tail(struct channel_t * c)
 {
-	int ret;
-
-	spin_lock(&c->lock);
-	ret = (c->in - c->out <= 0) ? 1 : 0;
-	spin_unlock(&c->lock);
+	if(c->mode == CHANNEL_MODE_MPSC)
+		return (unsigned int)atomic_get(&c->head);
+	return c->in;
+}
 
-	return ret;
+static inline int channel_isempty(struct channel_t * c)
+{
+	smp_rmb();
+	return (c->in - c->out <= 0) ? 1 : 0;
 }
 
 static inline int channel_isfull(struct channel_t * c)
 {
-	int ret;
+	smp_rmb();
+	return (channel_tail(c) - c->out >= c->size) ? 1 : 0;
+}
 
-	spin_lock(&c->lock);
-	ret = (c->in - c->out >= c->size) ? 1 : 0;
-	spin_unlock(&c->lock);
+static inline void channel_copy_in(struct channel_t * c, unsigned int in, unsigned char * buf, unsigned int len)
+{
+	unsigned int l;
 
-	return ret;
+	l = min(len, c->size - (in & (c->size - 1)));
+	memcpy(c->buffer + (in & (c->size - 1)), buf, l);
+	memcpy(c->buffer, buf + l, len - l);
 }
 
-static inline unsigned int __channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+static inline void channel_copy_out(struct channel_t * c, unsigned int out, unsigned char * buf, unsigned int len)
 {
 	unsigned int l;
 
+	l = min(len, c->size - (out & (c->size - 1)));
+	memcpy(buf, c->buffer + (out & (c->size - 1)), l);
+	memcpy(buf + l, c->buffer, len - l);
+}
+
+static inline unsigned int __channel_put_lock(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
 	spin_lock(&c->lock);
 	len = min(len, c->size - c->in + c->out);
 	smp_mb();
-	l = min(len, c->size - (c->in & (c->size - 1)));
-	memcpy(c->buffer + (c->in & (c->size - 1)), buf, l);
-	memcpy(c->buffer, buf + l, len - l);
+	channel_copy_in(c, c->in, buf, len);
 	smp_wmb();
 	c->in += len;
 	spin_unlock(&c->lock);
@@ -104,151 +122,382 @@ static inline unsigned int __channel_put(struct channel_t * c, unsigned char * b
 	return len;
 }
 
-static inline unsigned int __channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
+static inline unsigned int __channel_put_spsc(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	unsigned int l;
+	unsigned int in = c->in;
 
-	spin_lock(&c->lock);
-	len = min(len, c->in - c->out);
 	smp_rmb();
-	l = min(len, c->size - (c->out & (c->size - 1)));
-	memcpy(buf, c->buffer + (c->out & (c->size - 1)), l);
-	memcpy(buf + l, c->buffer, len - l);
+	len = min(len, c->size - in + c->out);
 	smp_mb();
-	c->out += len;
-	spin_unlock(&c->lock);
+	channel_copy_in(c, in, buf, len);
+	smp_wmb();
+	c->in = in + len;
 
 	return len;
 }
 
-static inline unsigned int channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+static inline unsigned int __channel_put_mpsc(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
-	unsigned int l;
+	unsigned int head, l;
 
-	if(channel_isfull(c))
+	do {
+		head = (unsigned int)atomic_get(&c->head);
+		l = min(len, c->size - head + c->out);
+		if(l == 0)
+			return 0;
+	} while(atomic_cmpxchg(&c->head, (int)head, (int)(head + l)) != (int)head);
+	smp_mb();
+	channel_copy_in(c, head, buf, l);
+	while(c->in != head)
 	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(list_empty_careful(&self->slist))
-		{
-			list_add_tail(&self->slist, &c->swait);
-		}
-		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_put(c, buf, len);
+		task_yield();
+		smp_mb();
 	}
-	else if(channel_isempty(c))
+	smp_wmb();
+	c->in = head + l;
+
+	return l;
+}
+
+static inline unsigned int __channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	switch(c->mode)
 	{
-		l = __channel_put(c, buf, len);
+	case CHANNEL_MODE_SPSC:
+		return __channel_put_spsc(c, buf, len);
+	case CHANNEL_MODE_MPSC:
+		return __channel_put_mpsc(c, buf, len);
+	default:
+		break;
+	}
+	return __channel_put_lock(c, buf, len);
+}
+
+static inline unsigned int __channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	unsigned int out;
+
+	if(c->mode == CHANNEL_MODE_LOCK)
 		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
+	out = c->out;
+	len = min(len, c->in - out);
+	smp_rmb();
+	channel_copy_out(c, out, buf, len);
+	smp_mb();
+	c->out = out + len;
+	if(c->mode == CHANNEL_MODE_LOCK)
 		spin_unlock(&c->lock);
+
+	return len;
+}
+
+/*
+ * Wake the first waiter only, the others stay queued. A waiter that has
+ * not suspended yet gets a pending wakeup, so its task_suspend returns at
+ * once and it goes on to recheck the channel.
+ */
+static inline void channel_wakeup(struct channel_t * c, struct list_head * head)
+{
+	struct channel_waiter_t * w;
+
+	smp_mb();
+	if(list_empty(head))
+		return;
+	spin_lock(&c->lock);
+	if(!list_empty(head))
+	{
+		w = list_first_entry(head, struct channel_waiter_t, list);
+		list_del_init(&w->list);
+		task_resume(w->task);
 	}
-	else
+	spin_unlock(&c->lock);
+}
+
+static inline void channel_wakeup_reader(struct channel_t * c)
+{
+	channel_wakeup(c, &c->rwait);
+}
+
+static inline void channel_wakeup_writer(struct channel_t * c)
+{
+	channel_wakeup(c, &c->swait);
+}
+
+static inline void channel_waiter_add(struct channel_t * c, struct list_head * head, struct channel_waiter_t * w)
+{
+	spin_lock(&c->lock);
+	if(list_empty_careful(&w->list))
+		list_add_tail(&w->list, head);
+	spin_unlock(&c->lock);
+}
+
+static inline void channel_waiter_del(struct channel_t * c, struct channel_waiter_t * w)
+{
+	spin_lock(&c->lock);
+	list_del_init(&w->list);
+	spin_unlock(&c->lock);
+}
+
+static inline void channel_wait_writer(struct channel_t * c)
+{
+	struct channel_waiter_t w;
+
+	w.task = task_self();
+	init_list_head(&w.list);
+	channel_waiter_add(c, &c->swait, &w);
+	smp_mb();
+	if(channel_isfull(c))
+		task_suspend(w.task);
+	channel_waiter_del(c, &w);
+}
+
+static inline void channel_wait_reader(struct channel_t * c)
+{
+	struct channel_waiter_t w;
+
+	w.task = task_self();
+	init_list_head(&w.list);
+	channel_waiter_add(c, &c->rwait, &w);
+	smp_mb();
+	if(channel_isempty(c))
+		task_suspend(w.task);
+	channel_waiter_del(c, &w);
+}
+
+static inline unsigned int channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	unsigned int l;
+
+	l = __channel_put(c, buf, len);
+	channel_wakeup_reader(c);
+	if(l == 0)
 	{
+		channel_wait_writer(c);
 		l = __channel_put(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		spin_unlock(&c->lock);
+		channel_wakeup_reader(c);
 	}
 	return l;
 }
 
 static inline unsigned int channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
 	unsigned int l;
 
-	if(channel_isempty(c))
+	l = __channel_get(c, buf, len);
+	channel_wakeup_writer(c);
+	if(l == 0)
 	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
+		channel_wait_reader(c);
+		l = __channel_get(c, buf, len);
+		channel_wakeup_writer(c);
+	}
+	return l;
+}
+
+/*
+ * Zero copy producer, reserve a contiguous span and commit it after writing,
+ * the returned length is clipped at the end of ring buffer. Except for the
+ * mpsc mode, only one task may produce through this interface at a time,
+ * and a mpsc producer must commit exactly what it has reserved.
+ */
+unsigned int channel_reserve(struct channel_t * c, unsigned int len, unsigned char ** ptr)
+{
+	unsigned int in, l;
+
+	if(!c || !ptr || (len == 0))
+		return 0;
+
+	while(1)
+	{
+		if(c->mode == CHANNEL_MODE_MPSC)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			in = (unsigned int)atomic_get(&c->head);
+			l = min(len, c->size - in + c->out);
+			l = min(l, c->size - (in & (c->size - 1)));
+			if((l > 0) && (atomic_cmpxchg(&c->head, (int)in, (int)(in + l)) != (int)in))
+				continue;
 		}
-		if(list_empty_careful(&self->rlist))
+		else
 		{
-			list_add_tail(&self->rlist, &c->rwait);
+			in = c->in;
+			smp_rmb();
+			l = min(len, c->size - in + c->out);
+			l = min(l, c->size - (in & (c->size - 1)));
 		}
-		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_get(c, buf, len);
+		if(l > 0)
+			break;
+		channel_wakeup_reader(c);
+		channel_wait_writer(c);
 	}
-	else if(channel_isfull(c))
+	smp_mb();
+	*ptr = c->buffer + (in & (c->size - 1));
+
+	return l;
+}
+
+void channel_commit(struct channel_t * c, unsigned char * ptr, unsigned int len)
+{
+	unsigned int in;
+
+	if(!c || !ptr)
+		return;
+
+	if(c->mode == CHANNEL_MODE_MPSC)
 	{
-		l = __channel_get(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
+		in = c->in;
+		in += ((unsigned int)(ptr - c->buffer) - (in & (c->size - 1))) & (c->size - 1);
+		while(c->in != in)
 		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			task_yield();
+			smp_mb();
 		}
-		spin_unlock(&c->lock);
 	}
 	else
 	{
-		l = __channel_get(c, buf, len);
+		in = c->in;
+		len = min(len, c->size - in + c->out);
+	}
+	smp_wmb();
+	c->in = in + len;
+	channel_wakeup_reader(c);
+}
+
+/*
+ * Zero copy consumer, peek a contiguous span in place and consume it after
+ * parsing. Only one task may consume through this interface at a time.
+ */
+unsigned int channel_peek(struct channel_t * c, unsigned char ** ptr)
+{
+	unsigned int out, l;
+
+	if(!c || !ptr)
+		return 0;
+
+	while(1)
+	{
+		out = c->out;
+		l = c->in - out;
+		smp_rmb();
+		l = min(l, c->size - (out & (c->size - 1)));
+		if(l > 0)
+			break;
+		channel_wakeup_writer(c);
+		channel_wait_reader(c);
+	}
+	*ptr = c->buffer + (out & (c->size - 1));
+
+	return l;
+}
+
+void channel_consume(struct channel_t * c, unsigned int len)
+{
+	unsigned int out;
+
+	if(!c)
+		return;
+
+	out = c->out;
+	len = min(len, c->in - out);
+	smp_mb();
+	c->out = out + len;
+	channel_wakeup_writer(c);
+}
+
+static int channel_select_scan(struct channel_select_t * sel, int n)
+{
+	int i, ret = 0;
+
+	for(i = 0; i < n; i++)
+	{
+		sel[i].revents = 0;
+		if(!sel[i].c)
+			continue;
+		if((sel[i].events & CHANNEL_EVENT_READ) && !channel_isempty(sel[i].c))
+			sel[i].revents |= CHANNEL_EVENT_READ;
+		if((sel[i].events & CHANNEL_EVENT_WRITE) && !channel_isfull(sel[i].c))
+			sel[i].revents |= CHANNEL_EVENT_WRITE;
+		if(sel[i].revents)
+			ret++;
+	}
+	return ret;
+}
+
+/*
+ * Dequeue the waiters and recheck each channel under its lock, so a wakeup
+ * racing with the timeout is seen before a timeout is reported.
+ */
+static int channel_select_finish(struct channel_select_t * sel, int n)
+{
+	struct channel_t * c;
+	int i, ret = 0;
+
+	for(i = 0; i < n; i++)
+	{
+		c = sel[i].c;
+		sel[i].revents = 0;
+		if(!c)
+			continue;
 		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
+		list_del_init(&sel[i].rw.list);
+		list_del_init(&sel[i].ww.list);
+		if((sel[i].events & CHANNEL_EVENT_READ) && !channel_isempty(c))
+			sel[i].revents |= CHANNEL_EVENT_READ;
+		if((sel[i].events & CHANNEL_EVENT_WRITE) && !channel_isfull(c))
+			sel[i].revents |= CHANNEL_EVENT_WRITE;
+		spin_unlock(&c->lock);
+		if(sel[i].revents)
+			ret++;
+	}
+	return ret;
+}
+
+/*
+ * Wait until one of channels becomes readable or writable, the timeout is
+ * in nanoseconds, a negative value waits forever and zero just polls. The
+ * ready set is reported by revents and the number of ready channels is
+ * returned, zero means timeout.
+ */
+int channel_select(struct channel_select_t * sel, int n, int64_t timeout)
+{
+	struct task_t * self = task_self();
+	ktime_t deadline;
+	int i, ret;
+
+	if(!sel || (n <= 0))
+		return 0;
+
+	if(timeout > 0)
+		deadline = ktime_add_safe(ktime_get(), ns_to_ktime(timeout));
+	ret = channel_select_scan(sel, n);
+	while((ret == 0) && (timeout != 0))
+	{
+		for(i = 0; i < n; i++)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			sel[i].rw.task = self;
+			sel[i].ww.task = self;
+			init_list_head(&sel[i].rw.list);
+			init_list_head(&sel[i].ww.list);
+			if(!sel[i].c)
+				continue;
+			if(sel[i].events & CHANNEL_EVENT_READ)
+				channel_waiter_add(sel[i].c, &sel[i].c->rwait, &sel[i].rw);
+			if(sel[i].events & CHANNEL_EVENT_WRITE)
+				channel_waiter_add(sel[i].c, &sel[i].c->swait, &sel[i].ww);
 		}
-		spin_unlock(&c->lock);
+		smp_mb();
+		if(channel_select_scan(sel, n) == 0)
+		{
+			if(timeout > 0)
+				timer_start(&self->timer, deadline, ktime_set(0, 0));
+			task_suspend(self);
+			if(timeout > 0)
+				timer_cancel(&self->timer);
+		}
+		ret = channel_select_finish(sel, n);
+		if((timeout > 0) && !ktime_before(ktime_get(), deadline))
+			break;
 	}
-	return l;
+	return ret;
 }
 
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
@@ -259,7 +508,8 @@ void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
 	{
 		do {
 			l += channel_put(c, buf + l, len - l);
-			task_yield();
+			if(l < len)
+				task_yield();
 		} while(l < len);
 	}
 }
@@ -272,7 +522,8 @@ void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
 	{
 		do {
 			l += channel_get(c, buf + l, len - l);
-			task_yield();
+			if(l < len)
+				task_yield();
 		} while(l < len);
 	}
 }
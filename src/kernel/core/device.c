@@ -33,6 +33,7 @@ struct list_head __device_list;
 struct list_head __device_head[DEVICE_TYPE_MAX_COUNT];
 static struct hlist_head __device_hash[CONFIG_DEVICE_HASH_SIZE];
 static spinlock_t __device_lock = SPIN_LOCK_INIT();
+static struct rwlock_t __device_rwlock;
 static struct notifier_chain_t __device_nc = NOTIFIER_CHAIN_INIT();
 
 static struct hlist_head * device_hash(const char * name)
@@ -227,9 +228,11 @@ char * alloc_device_name(const char * name, int id)
 
 	if(id < 0)
 		id = 0;
+	rwlock_read_lock(&__device_rwlock);
 	do {
 		snprintf(buf, sizeof(buf), "%s.%d", name, id++);
 	} while(device_exist(buf));
+	rwlock_read_unlock(&__device_rwlock);
 
 	return strdup(buf);
 }
@@ -248,11 +251,16 @@ struct device_t * search_device(const char * name, enum device_type_t type)
 	if(!name)
 		return NULL;
 
+	rwlock_read_lock(&__device_rwlock);
 	hlist_for_each_entry_safe(pos, n, device_hash(name), node)
 	{
 		if((pos->type == type) && (strcmp(pos->name, name) == 0))
+		{
+			rwlock_read_unlock(&__device_rwlock);
 			return pos;
+		}
 	}
+	rwlock_read_unlock(&__device_rwlock);
 	return NULL;
 }
 
@@ -273,13 +281,12 @@ bool_t register_device(struct device_t * dev)
 	if((dev->type < 0) || (dev->type >= ARRAY_SIZE(__device_head)))
 		return FALSE;
 
+	rwlock_write_lock(&__device_rwlock);
 	if(device_exist(dev->name))
+	{
+		rwlock_write_unlock(&__device_rwlock);
 		return FALSE;
-
-	kobj_add_regular(dev->kobj, "suspend", NULL, device_write_suspend, dev);
-	kobj_add_regular(dev->kobj, "resume", NULL, device_write_resume, dev);
-	kobj_add(search_device_kobj(dev), dev->kobj);
-
+	}
 	spin_lock_irqsave(&__device_lock, flags);
 	init_list_head(&dev->list);
 	list_add_tail(&dev->list, &__device_list);
@@ -288,6 +295,11 @@ bool_t register_device(struct device_t * dev)
 	init_hlist_node(&dev->node);
 	hlist_add_head(&dev->node, device_hash(dev->name));
 	spin_unlock_irqrestore(&__device_lock, flags);
+	rwlock_write_unlock(&__device_rwlock);
+
+	kobj_add_regular(dev->kobj, "suspend", NULL, device_write_suspend, dev);
+	kobj_add_regular(dev->kobj, "resume", NULL, device_write_resume, dev);
+	kobj_add(search_device_kobj(dev), dev->kobj);
 	notifier_chain_call(&__device_nc, NOTIFIER_DEVICE_ADD, dev);
 
 	return TRUE;
@@ -307,11 +319,13 @@ bool_t unregister_device(struct device_t * dev)
 		return FALSE;
 
 	notifier_chain_call(&__device_nc, NOTIFIER_DEVICE_REMOVE, dev);
+	rwlock_write_lock(&__device_rwlock);
 	spin_lock_irqsave(&__device_lock, flags);
 	list_del(&dev->list);
 	list_del(&dev->head);
 	hlist_del(&dev->node);
 	spin_unlock_irqrestore(&__device_lock, flags);
+	rwlock_write_unlock(&__device_rwlock);
 	kobj_remove(search_device_kobj(dev), dev->kobj);
 
 	return TRUE;
@@ -351,6 +365,7 @@ static __init void device_pure_init(void)
 {
 	int i;
 
+	rwlock_init(&__device_rwlock);
 	init_list_head(&__device_list);
 	for(i = 0; i < ARRAY_SIZE(__device_head); i++)
 		init_list_head(&__device_head[i]);
@@ -30,6 +30,7 @@
 #include <xboot/kobj.h>
 
 static struct kobj_t * __kobj_root = NULL;
+static struct kmem_cache_t * __kobj_cache = NULL;
 
 static struct kobj_t * __kobj_alloc(const char * name, enum kobj_type_t type, kobj_read_t read, kobj_write_t write, void * priv)
 {
@@ -38,7 +39,9 @@ static struct kobj_t * __kobj_alloc(const char * name, enum kobj_type_t type, ko
 	if(!name)
 		return NULL;
 
-	kobj = malloc(sizeof(struct kobj_t));
+	if(!__kobj_cache)
+		__kobj_cache = kmem_cache_create("kobj", sizeof(struct kobj_t), 0);
+	kobj = kmem_cache_alloc(__kobj_cache);
 	if(!kobj)
 		return NULL;
 
@@ -134,7 +137,7 @@ bool_t kobj_free(struct kobj_t * kobj)
 		return FALSE;
 
 	free(kobj->name);
-	free(kobj);
+	kmem_cache_free(__kobj_cache, kobj);
 	return TRUE;
 }
 
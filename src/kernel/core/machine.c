@@ -247,6 +247,22 @@ void machine_sleep(void)
 	}
 }
 
+void machine_idle(void)
+{
+	struct machine_t * mach = get_machine();
+
+	if(mach && mach->idle)
+		mach->idle(mach);
+}
+
+void machine_wakeup(int cpu)
+{
+	struct machine_t * mach = get_machine();
+
+	if(mach && mach->wakeup)
+		mach->wakeup(mach, cpu);
+}
+
 void machine_cleanup(void)
 {
 	struct machine_t * mach = get_machine();
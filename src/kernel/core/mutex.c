@@ -33,40 +33,157 @@ void mutex_init(struct mutex_t * m)
 {
 	atomic_set(&m->atomic, 1);
 	init_list_head(&m->mwait);
+	init_list_head(&m->held);
+	m->owner = NULL;
+	m->contention = 0;
 	spin_lock_init(&m->lock);
 }
 
+/*
+ * Each task keeps the mutexes it owns on its mheld list, and only the task
+ * itself or the one handing a mutex over to it while it sleeps touches the
+ * list. The nice value before the first of them is taken is kept in bnice.
+ */
+static inline void mutex_hold(struct mutex_t * m, struct task_t * task)
+{
+	if(task)
+	{
+		if(list_empty(&task->mheld))
+			task->bnice = task->nice;
+		list_add_tail(&m->held, &task->mheld);
+	}
+}
+
+static inline int mutex_trylock_fast(struct mutex_t * m, struct task_t * self)
+{
+	if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
+	{
+		m->owner = self;
+		mutex_hold(m, self);
+		return 1;
+	}
+	return 0;
+}
+
+#if defined(CONFIG_MAX_SMP_CPUS) && (CONFIG_MAX_SMP_CPUS > 1)
+static inline int mutex_spin_on_owner(struct mutex_t * m, struct task_t * self)
+{
+	struct task_t * owner;
+	int i;
+
+	for(i = 0; i < CONFIG_MUTEX_SPIN_COUNT; i++)
+	{
+		owner = m->owner;
+		if(owner && ((owner->status != TASK_STATUS_RUNNING) || (owner->sched == self->sched)))
+			break;
+		if((atomic_get(&m->atomic) == 1) && mutex_trylock_fast(m, self))
+			return 1;
+		smp_mb();
+	}
+	return 0;
+}
+#endif
+
+static inline void mutex_enqueue_waiter(struct mutex_t * m, struct task_t * self)
+{
+	struct task_t * pos;
+
+	list_for_each_entry(pos, &m->mwait, mlist)
+	{
+		if(self->nice < pos->nice)
+		{
+			list_add_tail(&self->mlist, &pos->mlist);
+			return;
+		}
+	}
+	list_add_tail(&self->mlist, &m->mwait);
+}
+
+static inline void mutex_boost_owner(struct mutex_t * m, struct task_t * self)
+{
+	struct task_t * owner = m->owner;
+
+	if(owner && (self->nice < owner->nice))
+		task_renice(owner, self->nice);
+}
+
+/*
+ * Recompute the boost of an owner releasing a mutex while boosted, it is
+ * the highest priority waiter over all the mutexes it still holds, falling
+ * back to the nice value it had before taking them.
+ */
+static inline void mutex_unboost_owner(struct task_t * self)
+{
+	struct mutex_t * pos;
+	struct task_t * top;
+	int nice;
+
+	nice = self->bnice;
+	list_for_each_entry(pos, &self->mheld, held)
+	{
+		spin_lock(&pos->lock);
+		if(!list_empty(&pos->mwait))
+		{
+			top = list_first_entry(&pos->mwait, struct task_t, mlist);
+			if(top->nice < nice)
+				nice = top->nice;
+		}
+		spin_unlock(&pos->lock);
+	}
+	if(self->nice != nice)
+		task_renice(self, nice);
+}
+
 void mutex_lock(struct mutex_t * m)
 {
-	struct task_t * self;
+	struct task_t * self = task_self();
+
+	if(mutex_trylock_fast(m, self))
+		return;
+	m->contention++;
 
-	while(atomic_cmpxchg(&m->atomic, 1, 0) != 1)
+#if defined(CONFIG_MAX_SMP_CPUS) && (CONFIG_MAX_SMP_CPUS > 1)
+	if(mutex_spin_on_owner(m, self))
+		return;
+#endif
+
+	spin_lock(&m->lock);
+	if(mutex_trylock_fast(m, self))
 	{
-		self = task_self();
-		spin_lock(&m->lock);
-		if(list_empty_careful(&self->mlist))
-			list_add_tail(&self->mlist, &m->mwait);
 		spin_unlock(&m->lock);
-		task_suspend(self);
+		return;
 	}
+	if(list_empty_careful(&self->mlist))
+		mutex_enqueue_waiter(m, self);
+	mutex_boost_owner(m, self);
+	spin_unlock(&m->lock);
+
+	while(m->owner != self)
+		task_suspend(self);
 }
 
 void mutex_unlock(struct mutex_t * m)
 {
-	struct task_t * pos, * n;
+	struct task_t * self = m->owner;
+	struct task_t * next;
 
-	if(atomic_cmpxchg(&m->atomic, 0, 1) == 0)
+	spin_lock(&m->lock);
+	list_del_init(&m->held);
+	if(self && (self->nice != self->bnice))
+		mutex_unboost_owner(self);
+	if(!list_empty(&m->mwait))
 	{
-		spin_lock(&m->lock);
-		if(!list_empty(&m->mwait))
-		{
-			list_for_each_entry_safe(pos, n, &m->mwait, mlist)
-			{
-				list_del_init(&pos->mlist);
-				task_resume(pos);
-				break;
-			}
-		}
+		next = list_first_entry(&m->mwait, struct task_t, mlist);
+		list_del_init(&next->mlist);
+		m->owner = next;
+		mutex_hold(m, next);
+		spin_unlock(&m->lock);
+		task_resume(next);
+	}
+	else
+	{
+		m->owner = NULL;
+		atomic_set(&m->atomic, 1);
 		spin_unlock(&m->lock);
 	}
 }
@@ -0,0 +1,138 @@
+/*
+ * kernel/core/rwlock.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/rwlock.h>
+
+struct rwlock_waiter_t {
+	struct list_head list;
+	struct task_t * task;
+	int granted;
+};
+
+void rwlock_init(struct rwlock_t * rw)
+{
+	rw->readers = 0;
+	rw->writer = 0;
+	rw->wwaiting = 0;
+	init_list_head(&rw->rwait);
+	init_list_head(&rw->wwait);
+	rawlock_init(&rw->lock);
+}
+
+static inline void rwlock_wait(struct rwlock_waiter_t * w)
+{
+	while(!w->granted)
+		task_suspend(w->task);
+}
+
+static inline void rwlock_grant(struct rwlock_waiter_t * w)
+{
+	struct task_t * task = w->task;
+
+	list_del_init(&w->list);
+	smp_wmb();
+	w->granted = 1;
+	task_resume(task);
+}
+
+static inline void rwlock_wakeup(struct rwlock_t * rw)
+{
+	struct rwlock_waiter_t * pos, * n;
+
+	if(!list_empty(&rw->wwait))
+	{
+		if(rw->readers == 0)
+		{
+			rw->writer = 1;
+			rw->wwaiting--;
+			rwlock_grant(list_first_entry(&rw->wwait, struct rwlock_waiter_t, list));
+		}
+	}
+	else
+	{
+		list_for_each_entry_safe(pos, n, &rw->rwait, list)
+		{
+			rw->readers++;
+			rwlock_grant(pos);
+		}
+	}
+}
+
+void rwlock_read_lock(struct rwlock_t * rw)
+{
+	struct rwlock_waiter_t w;
+
+	raw_lock(&rw->lock);
+	if(!rw->writer && (rw->wwaiting == 0))
+	{
+		rw->readers++;
+		raw_unlock(&rw->lock);
+		return;
+	}
+	w.task = task_self();
+	w.granted = 0;
+	list_add_tail(&w.list, &rw->rwait);
+	raw_unlock(&rw->lock);
+	rwlock_wait(&w);
+}
+
+void rwlock_read_unlock(struct rwlock_t * rw)
+{
+	raw_lock(&rw->lock);
+	if(--rw->readers == 0)
+		rwlock_wakeup(rw);
+	raw_unlock(&rw->lock);
+}
+
+void rwlock_write_lock(struct rwlock_t * rw)
+{
+	struct rwlock_waiter_t w;
+
+	raw_lock(&rw->lock);
+	if(!rw->writer && (rw->readers == 0))
+	{
+		rw->writer = 1;
+		raw_unlock(&rw->lock);
+		return;
+	}
+	w.task = task_self();
+	w.granted = 0;
+	list_add_tail(&w.list, &rw->wwait);
+	rw->wwaiting++;
+	raw_unlock(&rw->lock);
+	rwlock_wait(&w);
+}
+
+void rwlock_write_unlock(struct rwlock_t * rw)
+{
+	raw_lock(&rw->lock);
+	rw->writer = 0;
+	rwlock_wakeup(rw);
+	raw_unlock(&rw->lock);
+}
@@ -0,0 +1,103 @@
+/*
+ * kernel/core/semaphore.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/semaphore.h>
+
+struct semaphore_waiter_t {
+	struct list_head list;
+	struct task_t * task;
+	int granted;
+};
+
+void semaphore_init(struct semaphore_t * sem, int count)
+{
+	sem->count = count;
+	init_list_head(&sem->swait);
+	rawlock_init(&sem->lock);
+}
+
+int semaphore_trydown(struct semaphore_t * sem)
+{
+	irq_flags_t flags;
+	int ret = 0;
+
+	raw_lock_irqsave(&sem->lock, flags);
+	if(sem->count > 0)
+	{
+		sem->count--;
+		ret = 1;
+	}
+	raw_unlock_irqrestore(&sem->lock, flags);
+
+	return ret;
+}
+
+void semaphore_down(struct semaphore_t * sem)
+{
+	struct semaphore_waiter_t w;
+	irq_flags_t flags;
+
+	raw_lock_irqsave(&sem->lock, flags);
+	if(sem->count > 0)
+	{
+		sem->count--;
+		raw_unlock_irqrestore(&sem->lock, flags);
+		return;
+	}
+	w.task = task_self();
+	w.granted = 0;
+	list_add_tail(&w.list, &sem->swait);
+	raw_unlock_irqrestore(&sem->lock, flags);
+
+	while(!w.granted)
+		task_suspend(w.task);
+}
+
+void semaphore_up(struct semaphore_t * sem)
+{
+	struct semaphore_waiter_t * w;
+	struct task_t * task;
+	irq_flags_t flags;
+
+	raw_lock_irqsave(&sem->lock, flags);
+	if(!list_empty(&sem->swait))
+	{
+		w = list_first_entry(&sem->swait, struct semaphore_waiter_t, list);
+		task = w->task;
+		list_del_init(&w->list);
+		smp_wmb();
+		w->granted = 1;
+		task_resume(task);
+	}
+	else
+	{
+		sem->count++;
+	}
+	raw_unlock_irqrestore(&sem->lock, flags);
+}
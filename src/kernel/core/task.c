@@ -40,6 +40,20 @@ extern struct transfer_t jump_fcontext(void * fctx, void * priv);
 
 struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
 EXPORT_SYMBOL(__sched);
+static struct kmem_cache_t * __task_cache = NULL;
+
+#define TASK_STACK_MIN_ORDER	(12)
+#define TASK_STACK_MAX_ORDER	(20)
+#define TASK_STACK_GUARD_SIZE	(64)
+#define TASK_STACK_GUARD_MAGIC	(0xa5)
+#define TASK_STACK_PROBE_MAGIC	(0x5a)
+
+struct task_stack_cache_t {
+	void * head[TASK_STACK_MAX_ORDER - TASK_STACK_MIN_ORDER + 1];
+	int count[TASK_STACK_MAX_ORDER - TASK_STACK_MIN_ORDER + 1];
+	spinlock_t lock;
+};
+static struct task_stack_cache_t __stack_cache[CONFIG_MAX_SMP_CPUS];
 
 static const int nice_to_weight[40] = {
  /* -20 */     88761,     71755,     56483,     46273,     36291,
@@ -112,6 +126,93 @@ static inline uint64_t calc_delta_fair(struct task_t * task, uint64_t delta)
 	return delta;
 }
 
+static inline int task_stack_order(size_t stksz)
+{
+	int order = fls_long(stksz - 1);
+
+	if((order < TASK_STACK_MIN_ORDER) || (order > TASK_STACK_MAX_ORDER))
+		return -1;
+	return order;
+}
+
+static void * task_stack_alloc(size_t stksz)
+{
+	struct task_stack_cache_t * sc = &__stack_cache[smp_processor_id()];
+	int order = task_stack_order(stksz);
+	void * stack = NULL;
+	int i;
+
+	if(order >= 0)
+	{
+		i = order - TASK_STACK_MIN_ORDER;
+		spin_lock(&sc->lock);
+		if(sc->head[i])
+		{
+			stack = sc->head[i];
+			sc->head[i] = *((void **)stack);
+			sc->count[i]--;
+		}
+		spin_unlock(&sc->lock);
+	}
+	if(!stack)
+	{
+		stack = malloc(stksz);
+		if(!stack)
+			return NULL;
+	}
+	if(CONFIG_TASK_STACK_PROBE > 0)
+		memset(stack, TASK_STACK_PROBE_MAGIC, stksz);
+	memset(stack, TASK_STACK_GUARD_MAGIC, TASK_STACK_GUARD_SIZE);
+	return stack;
+}
+
+static void task_stack_free(void * stack, size_t stksz)
+{
+	struct task_stack_cache_t * sc = &__stack_cache[smp_processor_id()];
+	int order = task_stack_order(stksz);
+	int i;
+
+	if(order >= 0)
+	{
+		i = order - TASK_STACK_MIN_ORDER;
+		spin_lock(&sc->lock);
+		if(sc->count[i] < CONFIG_TASK_STACK_CACHE)
+		{
+			*((void **)stack) = sc->head[i];
+			sc->head[i] = stack;
+			sc->count[i]++;
+			spin_unlock(&sc->lock);
+			return;
+		}
+		spin_unlock(&sc->lock);
+	}
+	free(stack);
+}
+
+static inline void task_stack_check(struct task_t * task)
+{
+	unsigned char * p = task->stack;
+	int i;
+
+	for(i = 0; i < TASK_STACK_GUARD_SIZE; i++)
+	{
+		if(p[i] != TASK_STACK_GUARD_MAGIC)
+		{
+			LOG("Stack overflow in task '%s'", task->name ? task->name : "");
+			memset(p, TASK_STACK_GUARD_MAGIC, TASK_STACK_GUARD_SIZE);
+			break;
+		}
+	}
+}
+
+/*
+ * The ready tree and suspend list are reached from other cpus by the work
+ * stealing and remote wakeups, so the scheduler lock is a rawlock and is
+ * always taken with interrupts masked.
+ */
+#define scheduler_lock_irqsave(sched, flags)		raw_lock_irqsave(&(sched)->lock, flags)
+#define scheduler_unlock_irqrestore(sched, flags)	raw_unlock_irqrestore(&(sched)->lock, flags)
+
 static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sched)
 {
 	struct rb_node * leftmost = rb_first_cached(&sched->ready);
@@ -121,7 +222,7 @@ static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sch
 	return rb_entry(leftmost, struct task_t, node);
 }
 
-static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct task_t * task)
+static inline void __scheduler_enqueue_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct rb_node ** link = &sched->ready.rb_root.rb_node;
 	struct rb_node * parent = NULL;
@@ -145,6 +246,7 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 
 	rb_link_node(&task->node, parent, link);
 	rb_insert_color_cached(&task->node, &sched->ready, leftmost);
+	sched->nready++;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
@@ -154,11 +256,13 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 		sched->min_vtime = 0;
 }
 
-static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct task_t * task)
+static inline void __scheduler_dequeue_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct task_t * next;
 
 	rb_erase_cached(&task->node, &sched->ready);
+	RB_CLEAR_NODE(&task->node);
+	sched->nready--;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
@@ -168,13 +272,109 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 		sched->min_vtime = 0;
 }
 
+static inline struct task_t * __scheduler_pick_next_task(struct scheduler_t * sched, uint64_t now)
+{
+	struct task_t * next;
+
+	next = scheduler_next_ready_task(sched);
+	if(likely(next))
+	{
+		__scheduler_dequeue_task(sched, next);
+		next->status = TASK_STATUS_RUNNING;
+		next->parked = 0;
+		next->start = now;
+	}
+	return next;
+}
+
+static inline struct task_t * scheduler_pick_next_task(struct scheduler_t * sched, uint64_t now)
+{
+	struct task_t * next;
+	irq_flags_t flags;
+
+	scheduler_lock_irqsave(sched, flags);
+	next = __scheduler_pick_next_task(sched, now);
+	scheduler_unlock_irqrestore(sched, flags);
+
+	return next;
+}
+
+/*
+ * Lock the scheduler a task belongs to, retrying if the task migrated
+ * between reading its scheduler and taking the lock.
+ */
+static inline struct scheduler_t * task_sched_lock(struct task_t * task, irq_flags_t * flags)
+{
+	struct scheduler_t * sched;
+
+	while(1)
+	{
+		sched = task->sched;
+		scheduler_lock_irqsave(sched, *flags);
+		if(likely(task->sched == sched))
+			return sched;
+		scheduler_unlock_irqrestore(sched, *flags);
+	}
+}
+
+static inline void __task_wakeup(struct scheduler_t * sched, struct task_t * task)
+{
+	task->wakeup = ktime_to_ns(ktime_get());
+	task->vtime = sched->min_vtime;
+	task->status = TASK_STATUS_READY;
+	task->parked = 0;
+	task->woken = 0;
+	list_del_init(&task->list);
+	__scheduler_enqueue_task(sched, task);
+}
+
+/*
+ * The slice timer only runs while a task other than idle has competition
+ * for the cpu. It is armed from task context, never from an enqueue, as
+ * wakeups also come from timer callbacks holding the timer base lock.
+ */
+static inline void scheduler_slice_arm(struct scheduler_t * sched)
+{
+	if((CONFIG_TASK_PREEMPT_GRANULARITY > 0) && !sched->slicing && (sched->nready > 0) && sched->running && (sched->running != sched->idle))
+	{
+		sched->slicing = 1;
+		timer_start_now(&sched->timer, ns_to_ktime(CONFIG_TASK_PREEMPT_GRANULARITY));
+	}
+}
+
+/*
+ * Runs on the new stack once the previous task has switched out. Only
+ * from here on may a task that left the cpu be run again, so a wakeup
+ * that raced with its way out is replayed now.
+ */
+static inline void scheduler_finish_switch(struct task_t * task, void * fctx)
+{
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
+	if(!task)
+		return;
+	task->fctx = fctx;
+	if(task->status != TASK_STATUS_RUNNING)
+	{
+		sched = task_sched_lock(task, &flags);
+		task->parked = 1;
+		if((task->status == TASK_STATUS_SUSPEND) && task->woken)
+			__task_wakeup(sched, task);
+		scheduler_unlock_irqrestore(sched, flags);
+	}
+}
+
 static inline void scheduler_switch_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct task_t * running = sched->running;
+	task->nswitch++;
+	task->latency += task->start - task->wakeup;
+	trace_record(TRACE_TYPE_SWITCH, running, task, task->start);
 	sched->running = task;
 	struct transfer_t from = jump_fcontext(task->fctx, running);
-	struct task_t * t = (struct task_t *)from.priv;
-	t->fctx = from.fctx;
+	scheduler_finish_switch((struct task_t *)from.priv, from.fctx);
+	scheduler_slice_arm(scheduler_self());
 }
 
 static inline struct scheduler_t * scheduler_load_balance_choice(void)
@@ -194,29 +394,122 @@ static inline struct scheduler_t * scheduler_load_balance_choice(void)
 	return sched;
 }
 
+#if defined(CONFIG_MAX_SMP_CPUS) && (CONFIG_MAX_SMP_CPUS > 1)
+static inline struct scheduler_t * scheduler_busiest_choice(struct scheduler_t * self)
+{
+	struct scheduler_t * sched = NULL;
+	int nready = 1;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((&__sched[i] != self) && (__sched[i].nready > nready))
+		{
+			sched = &__sched[i];
+			nready = __sched[i].nready;
+		}
+	}
+	return sched;
+}
+
+static void scheduler_steal_task(struct scheduler_t * sched)
+{
+	struct scheduler_t * busiest;
+	struct rb_node * rbn;
+	struct task_t * task, * n;
+	struct list_head migrate;
+	irq_flags_t flags;
+	uint64_t vmin;
+	int count;
+
+	busiest = scheduler_busiest_choice(sched);
+	if(!busiest)
+		return;
+
+	init_list_head(&migrate);
+	scheduler_lock_irqsave(busiest, flags);
+	vmin = busiest->min_vtime;
+	count = busiest->nready >> 1;
+	rbn = rb_first_cached(&busiest->ready);
+	while(rbn && (count > 0))
+	{
+		task = rb_entry(rbn, struct task_t, node);
+		rbn = rb_next(rbn);
+		if((task != busiest->idle) && task->parked)
+		{
+			__scheduler_dequeue_task(busiest, task);
+			busiest->weight -= task->weight;
+			list_add_tail(&task->list, &migrate);
+			count--;
+		}
+	}
+	scheduler_unlock_irqrestore(busiest, flags);
+
+	list_for_each_entry_safe(task, n, &migrate, list)
+	{
+		list_del_init(&task->list);
+		task->vtime = task->vtime - vmin + sched->min_vtime;
+		task->sched = sched;
+		scheduler_lock_irqsave(sched, flags);
+		sched->weight += task->weight;
+		__scheduler_enqueue_task(sched, task);
+		scheduler_unlock_irqrestore(sched, flags);
+	}
+}
+#endif
+
+static int task_sleep_timer_function(struct timer_t * timer, void * data)
+{
+	struct task_t * task = (struct task_t *)data;
+
+	if((task->status == TASK_STATUS_SUSPEND) && task->parked)
+	{
+		task_resume(task);
+		return 0;
+	}
+	timer_forward_now(timer, us_to_ktime(100));
+	return 1;
+}
+
+static int scheduler_slice_timer_function(struct timer_t * timer, void * data)
+{
+	struct scheduler_t * sched = (struct scheduler_t *)data;
+	struct task_t * task = sched->running;
+	uint64_t vtime;
+
+	if(!task || (task == sched->idle) || (sched->nready <= 0))
+	{
+		sched->slicing = 0;
+		return 0;
+	}
+	vtime = task->vtime + calc_delta_fair(task, ktime_to_ns(ktime_get()) - task->start);
+	if((int64_t)(vtime - sched->min_vtime) > CONFIG_TASK_PREEMPT_GRANULARITY)
+		sched->need_resched = 1;
+	timer_forward_now(timer, ns_to_ktime(CONFIG_TASK_PREEMPT_GRANULARITY));
+	return 1;
+}
+
 static void fcontext_entry_func(struct transfer_t from)
 {
 	struct task_t * t = (struct task_t *)from.priv;
 	struct scheduler_t * sched = t->sched;
 	struct task_t * next, * task = sched->running;
 
-	t->fctx = from.fctx;
+	scheduler_finish_switch(t, from.fctx);
+	scheduler_slice_arm(sched);
 	task->func(task, task->data);
 	task_destroy(task);
+	sched->running = NULL;
 
-	next = scheduler_next_ready_task(sched);
+	next = scheduler_pick_next_task(sched, ktime_to_ns(ktime_get()));
 	if(likely(next))
-	{
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
-		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
-	}
 }
 
 struct task_t * task_create(struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice)
 {
 	struct task_t * task;
+	irq_flags_t flags;
 	void * stack;
 
 	if(!func)
@@ -227,69 +520,83 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 
 	if(stksz <= 0)
 		stksz = CONFIG_TASK_STACK_SIZE;
+	if(task_stack_order(stksz) >= 0)
+		stksz = roundup_pow_of_two(stksz);
 
 	if(nice < -20)
 		nice = -20;
 	else if(nice > 19)
 		nice = 19;
 
-	task = malloc(sizeof(struct task_t));
+	task = kmem_cache_alloc(__task_cache);
 	if(!task)
 		return NULL;
 
-	stack = malloc(stksz);
+	stack = task_stack_alloc(stksz);
 	if(!stack)
 	{
-		free(task);
+		kmem_cache_free(__task_cache, task);
 		return NULL;
 	}
 
 	RB_CLEAR_NODE(&task->node);
 	init_list_head(&task->list);
-	init_list_head(&task->slist);
-	init_list_head(&task->rlist);
 	init_list_head(&task->mlist);
-	spin_lock(&sched->lock);
+	init_list_head(&task->mheld);
+	scheduler_lock_irqsave(sched, flags);
 	list_add_tail(&task->list, &sched->suspend);
 	sched->weight += nice_to_weight[nice + 20];
-	spin_unlock(&sched->lock);
+	scheduler_unlock_irqrestore(sched, flags);
 
 	task->name = strdup(name);
 	task->status = TASK_STATUS_SUSPEND;
+	task->parked = 1;
+	task->woken = 0;
 	task->start = ktime_to_ns(ktime_get());
 	task->time = 0;
 	task->vtime = 0;
+	task->wakeup = task->start;
+	task->latency = 0;
+	task->nswitch = 0;
 	task->sched = sched;
 	task->stack = stack;
 	task->stksz = stksz;
 	task->nice = nice;
+	task->bnice = nice;
 	task->weight = nice_to_weight[nice + 20];
 	task->inv_weight = nice_to_wmult[nice + 20];
 	task->fctx = make_fcontext(task->stack + stksz, task->stksz, fcontext_entry_func);
 	task->func = func;
 	task->data = data;
 	task->__errno = 0;
+	timer_init(&task->timer, task_sleep_timer_function, task);
+	task->preempt = 0;
 
 	return task;
 }
 
 void task_destroy(struct task_t * task)
 {
+	irq_flags_t flags;
+
 	if(task)
 	{
-		spin_lock(&task->sched->lock);
+		timer_cancel(&task->timer);
+		scheduler_lock_irqsave(task->sched, flags);
 		task->sched->weight -= nice_to_weight[task->nice + 20];
-		spin_unlock(&task->sched->lock);
+		scheduler_unlock_irqrestore(task->sched, flags);
 
 		if(task->name)
 			free(task->name);
-		free(task->stack);
-		free(task);
+		task_stack_free(task->stack, task->stksz);
+		kmem_cache_free(__task_cache, task);
 	}
 }
 
 void task_renice(struct task_t * task, int nice)
 {
+	irq_flags_t flags;
+
 	if(nice < -20)
 		nice = -20;
 	else if(nice > 19)
@@ -297,10 +604,10 @@ void task_renice(struct task_t * task, int nice)
 
 	if(task->nice != nice)
 	{
-		spin_lock(&task->sched->lock);
+		scheduler_lock_irqsave(task->sched, flags);
 		task->sched->weight -= nice_to_weight[task->nice + 20];
 		task->sched->weight += nice_to_weight[nice + 20];
-		spin_unlock(&task->sched->lock);
+		scheduler_unlock_irqrestore(task->sched, flags);
 
 		task->nice = nice;
 		task->weight = nice_to_weight[nice + 20];
@@ -308,55 +615,93 @@ void task_renice(struct task_t * task, int nice)
 	}
 }
 
+/*
+ * A task may return from suspending itself without anyone having met its
+ * condition, callers must recheck it in a loop. A resume that arrives
+ * before the task has switched out is kept and makes the suspend return.
+ */
 void task_suspend(struct task_t * task)
 {
+	struct scheduler_t * sched;
 	struct task_t * next;
+	irq_flags_t flags;
 	uint64_t now, detla;
 
 	if(task)
 	{
+		sched = task_sched_lock(task, &flags);
 		if(task->status == TASK_STATUS_READY)
 		{
 			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
-			scheduler_dequeue_task(task->sched, task);
+			if(!RB_EMPTY_NODE(&task->node))
+				__scheduler_dequeue_task(sched, task);
+			list_add_tail(&task->list, &sched->suspend);
+			scheduler_unlock_irqrestore(sched, flags);
 		}
 		else if(task->status == TASK_STATUS_RUNNING)
 		{
 			now = ktime_to_ns(ktime_get());
 			detla = now - task->start;
-
 			task->time += detla;
 			task->vtime += calc_delta_fair(task, detla);
+			task->start = now;
+			if(task->woken)
+			{
+				task->woken = 0;
+				scheduler_unlock_irqrestore(sched, flags);
+				return;
+			}
 			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
+			list_add_tail(&task->list, &sched->suspend);
+			next = __scheduler_pick_next_task(sched, now);
+			if(!next)
+			{
+				list_del_init(&task->list);
+				task->status = TASK_STATUS_RUNNING;
+			}
+			scheduler_unlock_irqrestore(sched, flags);
 
-			next = scheduler_next_ready_task(task->sched);
 			if(next)
 			{
-				scheduler_dequeue_task(task->sched, next);
-				next->status = TASK_STATUS_RUNNING;
-				next->start = now;
-				scheduler_switch_task(task->sched, next);
+				task_stack_check(task);
+				trace_record(TRACE_TYPE_SUSPEND, task, task, now);
+				scheduler_switch_task(sched, next);
 			}
 		}
+		else
+		{
+			scheduler_unlock_irqrestore(sched, flags);
+		}
 	}
 }
 
 void task_resume(struct task_t * task)
 {
-	if(task && (task->status == TASK_STATUS_SUSPEND))
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+	int wake = 0;
+
+	if(task)
 	{
-		task->vtime = task->sched->min_vtime;
-		task->status = TASK_STATUS_READY;
-		spin_lock(&task->sched->lock);
-		list_del_init(&task->list);
-		spin_unlock(&task->sched->lock);
-		scheduler_enqueue_task(task->sched, task);
+		sched = task_sched_lock(task, &flags);
+		if((task->status == TASK_STATUS_SUSPEND) && task->parked)
+		{
+			__task_wakeup(sched, task);
+			wake = 1;
+		}
+		else if(task->status != TASK_STATUS_READY)
+		{
+			task->woken = 1;
+		}
+		scheduler_unlock_irqrestore(sched, flags);
+
+		if(wake)
+		{
+			trace_record(TRACE_TYPE_WAKEUP, task_self(), task, task->wakeup);
+			smp_mb();
+			if(sched->idling)
+				machine_wakeup(sched - &__sched[0]);
+		}
 	}
 }
 
@@ -364,11 +709,14 @@ void task_yield(void)
 {
 	struct scheduler_t * sched = scheduler_self();
 	struct task_t * next, * self = task_self();
+	irq_flags_t flags;
 	uint64_t now = ktime_to_ns(ktime_get());
 	uint64_t detla = now - self->start;
 
+	sched->need_resched = 0;
 	self->time += detla;
 	self->vtime += calc_delta_fair(self, detla);
+	task_stack_check(self);
 
 	if((int64_t)(self->vtime - sched->min_vtime) < 0)
 	{
@@ -376,17 +724,88 @@ void task_yield(void)
 	}
 	else
 	{
+		scheduler_lock_irqsave(sched, flags);
 		self->status = TASK_STATUS_READY;
-		scheduler_enqueue_task(sched, self);
-		next = scheduler_next_ready_task(sched);
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
-		next->start = now;
+		self->wakeup = now;
+		__scheduler_enqueue_task(sched, self);
+		next = __scheduler_pick_next_task(sched, now);
+		scheduler_unlock_irqrestore(sched, flags);
 		if(likely(next != self))
+		{
+			trace_record(TRACE_TYPE_YIELD, self, next, now);
 			scheduler_switch_task(sched, next);
+		}
+	}
+}
+
+void task_wait_until(ktime_t deadline)
+{
+	struct task_t * self = task_self();
+
+	if(!self)
+	{
+		while(ktime_before(ktime_get(), deadline));
+		return;
+	}
+	while(ktime_before(ktime_get(), deadline))
+	{
+		timer_start(&self->timer, deadline, ktime_set(0, 0));
+		task_suspend(self);
+		timer_cancel(&self->timer);
+	}
+}
+
+void task_sleep(uint64_t ns)
+{
+	task_wait_until(ktime_add_safe(ktime_get(), ns_to_ktime(ns)));
+}
+
+size_t task_stack_usage(struct task_t * task)
+{
+	unsigned char * p;
+	size_t i;
+
+	if(!task || (CONFIG_TASK_STACK_PROBE <= 0))
+		return 0;
+	p = task->stack;
+	for(i = TASK_STACK_GUARD_SIZE; i < task->stksz; i++)
+	{
+		if(p[i] != TASK_STACK_PROBE_MAGIC)
+			break;
+	}
+	return task->stksz - i;
+}
+
+void task_preempt_disable(void)
+{
+	struct task_t * self = task_self();
+
+	if(self)
+		self->preempt++;
+}
+
+void task_preempt_enable(void)
+{
+	struct task_t * self = task_self();
+
+	if(self && (--self->preempt <= 0))
+	{
+		self->preempt = 0;
+		task_preempt_point();
 	}
 }
 
+void task_preempt_point(void)
+{
+	struct scheduler_t * sched = scheduler_self();
+	struct task_t * self = sched->running;
+
+	if(sched->need_resched && self && (self->preempt <= 0))
+		task_yield();
+	else
+		scheduler_slice_arm(sched);
+}
+
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data)
 {
 	struct task_data_t * td;
@@ -412,10 +831,31 @@ void task_data_free(struct task_data_t * td)
 	}
 }
 
+/*
+ * Once idling is set every wakeup aimed at this cpu sends an event, so a
+ * task enqueued between the check and the wait makes machine_idle return
+ * at once instead of being lost until the next interrupt.
+ */
 static void idle_task(struct task_t * task, void * data)
 {
+	struct scheduler_t * sched = task->sched;
+	irq_flags_t flags;
+	int idle;
+
 	while(1)
 	{
+#if defined(CONFIG_MAX_SMP_CPUS) && (CONFIG_MAX_SMP_CPUS > 1)
+		if(sched->nready <= 0)
+			scheduler_steal_task(sched);
+#endif
+		local_irq_save(flags);
+		sched->idling = 1;
+		smp_mb();
+		idle = (sched->nready <= 0);
+		local_irq_restore(flags);
+		if(idle)
+			machine_idle();
+		sched->idling = 0;
 		task_yield();
 	}
 }
@@ -425,23 +865,22 @@ static void smpboot_entry_func(void)
 	machine_smpinit();
 
 	struct scheduler_t * sched = scheduler_self();
+	irq_flags_t flags;
 	struct task_t * task = task_create(sched, "idle", idle_task, (void *)(unsigned long)(smp_processor_id()), SZ_8K, 0);
-	spin_lock(&sched->lock);
+	scheduler_lock_irqsave(sched, flags);
 	sched->weight -= task->weight;
 	task->nice = 26;
 	task->weight = 3;
 	task->inv_weight = 1431655765;
 	sched->weight += task->weight;
-	spin_unlock(&sched->lock);
+	sched->idle = task;
+	scheduler_unlock_irqrestore(sched, flags);
 	task_resume(task);
 
-	struct task_t * next = scheduler_next_ready_task(sched);
+	struct task_t * next = scheduler_pick_next_task(sched, ktime_to_ns(ktime_get()));
 	if(next)
 	{
 		sched->running = next;
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
-		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
 	}
 }
@@ -451,23 +890,22 @@ void scheduler_loop(void)
 	machine_smpboot(smpboot_entry_func);
 
 	struct scheduler_t * sched = scheduler_self();
+	irq_flags_t flags;
 	struct task_t * task = task_create(sched, "idle", idle_task, (void *)(unsigned long)smp_processor_id(), SZ_8K, 0);
-	spin_lock(&sched->lock);
+	scheduler_lock_irqsave(sched, flags);
 	sched->weight -= task->weight;
 	task->nice = 26;
 	task->weight = 3;
 	task->inv_weight = 1431655765;
 	sched->weight += task->weight;
-	spin_unlock(&sched->lock);
+	sched->idle = task;
+	scheduler_unlock_irqrestore(sched, flags);
 	task_resume(task);
 
-	struct task_t * next = scheduler_next_ready_task(sched);
+	struct task_t * next = scheduler_pick_next_task(sched, ktime_to_ns(ktime_get()));
 	if(next)
 	{
 		sched->running = next;
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
-		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
 	}
 }
@@ -477,17 +915,23 @@ void do_init_sched(void)
 	struct scheduler_t * sched;
 	int i;
 
+	__task_cache = kmem_cache_create("task", sizeof(struct task_t), 0);
 	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
 	{
+		spin_lock_init(&__stack_cache[i].lock);
 		sched = &__sched[i];
 
-		spin_lock_init(&sched->lock);
-		spin_lock(&sched->lock);
+		rawlock_init(&sched->lock);
 		sched->ready = RB_ROOT_CACHED;
 		init_list_head(&sched->suspend);
 		sched->running = NULL;
+		sched->idle = NULL;
 		sched->min_vtime = 0;
 		sched->weight = 0;
-		spin_unlock(&sched->lock);
+		sched->nready = 0;
+		sched->need_resched = 0;
+		sched->idling = 0;
+		sched->slicing = 0;
+		timer_init(&sched->timer, scheduler_slice_timer_function, sched);
 	}
 }
@@ -0,0 +1,178 @@
+/*
+ * kernel/core/trace.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/trace.h>
+
+struct trace_ring_t {
+	struct trace_event_t event[CONFIG_TRACE_RING_SIZE];
+	unsigned int head;
+};
+
+static struct trace_ring_t __trace_ring[CONFIG_MAX_SMP_CPUS];
+int __trace_enable = 0;
+
+static const char * trace_type_tostring(enum trace_type_t type)
+{
+	switch(type)
+	{
+	case TRACE_TYPE_SWITCH:
+		return "switch";
+	case TRACE_TYPE_WAKEUP:
+		return "wakeup";
+	case TRACE_TYPE_SUSPEND:
+		return "suspend";
+	case TRACE_TYPE_YIELD:
+		return "yield";
+	default:
+		break;
+	}
+	return "";
+}
+
+void __trace_record(enum trace_type_t type, struct task_t * prev, struct task_t * next, uint64_t time)
+{
+	struct trace_ring_t * r = &__trace_ring[smp_processor_id()];
+	struct trace_event_t * e;
+	irq_flags_t flags;
+
+	local_irq_save(flags);
+	e = &r->event[r->head & (CONFIG_TRACE_RING_SIZE - 1)];
+	e->time = time;
+	e->type = type;
+	e->prev = prev;
+	e->next = next;
+	strlcpy(e->pname, (prev && prev->name) ? prev->name : "", sizeof(e->pname));
+	strlcpy(e->nname, (next && next->name) ? next->name : "", sizeof(e->nname));
+	smp_wmb();
+	r->head++;
+	local_irq_restore(flags);
+}
+
+void trace_start(void)
+{
+	__trace_enable = 1;
+}
+
+void trace_stop(void)
+{
+	__trace_enable = 0;
+}
+
+void trace_clear(void)
+{
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		__trace_ring[i].head = 0;
+}
+
+/*
+ * Dump all rings as chrome trace event format, which can be loaded by
+ * chrome://tracing or perfetto ui. Each cpu is a thread, running slices
+ * are begin and end pairs, other events are instants.
+ */
+ssize_t trace_json(char * buf, size_t size)
+{
+	struct trace_ring_t * r;
+	struct trace_event_t * e;
+	unsigned int head, start, n;
+	int running, first = 1;
+	size_t len = 0;
+	int i;
+
+	if(!buf || (size < 64))
+		return 0;
+
+	len += snprintf(buf + len, size - len, "{\"traceEvents\":[");
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		r = &__trace_ring[i];
+		head = r->head;
+		smp_rmb();
+		start = (head > CONFIG_TRACE_RING_SIZE) ? head - CONFIG_TRACE_RING_SIZE : 0;
+		running = 0;
+		for(n = start; (n != head) && (len + 256 < size); n++)
+		{
+			e = &r->event[n & (CONFIG_TRACE_RING_SIZE - 1)];
+			if(e->type == TRACE_TYPE_SWITCH)
+			{
+				if(running)
+					len += snprintf(buf + len, size - len, ",{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%llu.%03llu,\"pid\":0,\"tid\":%d}", e->pname, e->time / 1000, e->time % 1000, i);
+				len += snprintf(buf + len, size - len, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%llu.%03llu,\"pid\":0,\"tid\":%d,\"args\":{\"prev\":\"%s\"}}", (first && !running) ? "" : ",", e->nname, e->time / 1000, e->time % 1000, i, e->pname);
+				running = 1;
+			}
+			else
+			{
+				len += snprintf(buf + len, size - len, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu.%03llu,\"pid\":0,\"tid\":%d,\"args\":{\"task\":\"%s\"}}", first ? "" : ",", trace_type_tostring(e->type), e->time / 1000, e->time % 1000, i, e->nname);
+			}
+			first = 0;
+		}
+	}
+	len += snprintf(buf + len, size - len, "]}");
+	return min(len, size - 1);
+}
+
+static ssize_t trace_read_enable(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%d", __trace_enable);
+}
+
+static ssize_t trace_write_enable(struct kobj_t * kobj, void * buf, size_t size)
+{
+	if(strtol(buf, NULL, 0) != 0)
+		trace_start();
+	else
+		trace_stop();
+	return size;
+}
+
+static ssize_t trace_read_json(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return trace_json(buf, size);
+}
+
+static ssize_t trace_write_clear(struct kobj_t * kobj, void * buf, size_t size)
+{
+	trace_clear();
+	return size;
+}
+
+static __init void trace_init(void)
+{
+	struct kobj_t * kobj;
+
+	kobj = kobj_search_directory_with_create(kobj_search_directory_with_create(kobj_get_root(), "kernel"), "trace");
+	if(kobj)
+	{
+		kobj_add_regular(kobj, "enable", trace_read_enable, trace_write_enable, NULL);
+		kobj_add_regular(kobj, "clear", NULL, trace_write_clear, NULL);
+		kobj_add_regular(kobj, "json", trace_read_json, NULL, NULL);
+	}
+}
+core_initcall(trace_init);
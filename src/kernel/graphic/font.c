@@ -70,6 +70,7 @@ static FT_Stream ft_new_xfs_stream(struct xfs_context_t * xfs, const char * path
 {
 	FT_Stream stream = NULL;
 	struct xfs_file_t * file;
+	void * map;
 
 	stream = malloc(sizeof(*stream));
 	if(!stream)
@@ -93,8 +94,18 @@ static FT_Stream ft_new_xfs_stream(struct xfs_context_t * xfs, const char * path
 
 	stream->descriptor.pointer = file;
 	stream->pathname.pointer = (char *)pathname;
-	stream->read = ft_xfs_stream_io;
+	stream->pos = 0;
 	stream->close = ft_xfs_stream_close;
+	if((map = xfs_map(file)))
+	{
+		stream->base = map;
+		stream->read = NULL;
+	}
+	else
+	{
+		stream->base = NULL;
+		stream->read = ft_xfs_stream_io;
+	}
 
     return stream;
 }
@@ -32,6 +32,7 @@
 #include <jpeglib.h>
 #include <jerror.h>
 #include <qrcgen.h>
+#include <dma/dmapool.h>
 #include <graphic/surface.h>
 
 static struct list_head __render_list = {
@@ -150,6 +151,45 @@ struct surface_t * surface_alloc(int width, int height, void * priv)
 	s->r = search_render();
 	s->rctx = s->r->create(s);
 	s->priv = priv;
+	s->pool = NULL;
+	return s;
+}
+
+struct surface_t * surface_alloc_from_dma_pool(struct dma_pool_t * pool, int width, int height, void * priv)
+{
+	struct surface_t * s;
+	void * pixels;
+	int stride, pixlen;
+
+	if(!pool || width < 0 || height < 0)
+		return NULL;
+
+	stride = width << 2;
+	pixlen = height * stride;
+	if(pixlen > pool->size)
+		return NULL;
+
+	s = malloc(sizeof(struct surface_t));
+	if(!s)
+		return NULL;
+
+	pixels = dma_pool_alloc(pool);
+	if(!pixels)
+	{
+		free(s);
+		return NULL;
+	}
+	memset(pixels, 0, pixlen);
+
+	s->width = width;
+	s->height = height;
+	s->stride = stride;
+	s->pixlen = pixlen;
+	s->pixels = pixels;
+	s->r = search_render();
+	s->rctx = s->r->create(s);
+	s->priv = priv;
+	s->pool = pool;
 	return s;
 }
 
@@ -159,7 +199,10 @@ void surface_free(struct surface_t * s)
 	{
 		if(s->r)
 			s->r->destroy(s->rctx);
-		free(s->pixels);
+		if(s->pool)
+			dma_pool_free(s->pool, s->pixels);
+		else
+			free(s->pixels);
 		free(s);
 	}
 }
@@ -358,6 +401,7 @@ struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int
 	o->r = s->r;
 	o->rctx = o->r->create(o);
 	o->priv = NULL;
+	o->pool = NULL;
 	return o;
 }
 
@@ -447,6 +491,7 @@ struct surface_t * surface_extend(struct surface_t * s, int width, int height, c
 	o->r = s->r;
 	o->rctx = o->r->create(o);
 	o->priv = NULL;
+	o->pool = NULL;
 	return o;
 }
 
@@ -528,15 +573,23 @@ void surface_get_pixel(struct surface_t * s, int x, int y, struct color_t * c)
 	}
 }
 
+struct png_xfs_source_t {
+	const png_byte * data;
+	size_t size;
+	size_t offset;
+};
+
 static void png_xfs_read_data(png_structp png, png_bytep data, size_t length)
 {
-	size_t check;
+	struct png_xfs_source_t * src;
 
 	if(png == NULL)
 		return;
-	check = xfs_read((struct xfs_file_t *)png->io_ptr, data, length);
-	if(check != length)
+	src = (struct png_xfs_source_t *)png->io_ptr;
+	if(length > src->size - src->offset)
 		png_error(png, "Read Error");
+	memcpy(data, src->data + src->offset, length);
+	src->offset += length;
 }
 
 static inline int multiply_alpha(int alpha, int color)
@@ -605,10 +658,20 @@ static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t
 	int depth, color_type, interlace, stride;
 	unsigned int i;
 	struct xfs_file_t * file;
+	struct png_xfs_source_t src;
 
 	if(!(file = xfs_open_read(ctx, filename)))
 		return NULL;
 
+	src.data = xfs_map(file);
+	src.size = xfs_length(file);
+	src.offset = 0;
+	if(!src.data)
+	{
+		xfs_close(file);
+		return NULL;
+	}
+
 	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if(!png)
 	{
@@ -624,7 +687,7 @@ static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t
 		return NULL;
 	}
 
-	png_set_read_fn(png, file, png_xfs_read_data);
+	png_set_read_fn(png, &src, png_xfs_read_data);
 
 #ifdef PNG_SETJMP_SUPPORTED
 	if(setjmp(png_jmpbuf(png)))
@@ -706,14 +769,6 @@ struct x_error_mgr
 	jmp_buf setjmp_buffer;
 };
 
-struct x_source_mgr
-{
-	struct jpeg_source_mgr pub;
-	struct xfs_file_t * file;
-	JOCTET * buffer;
-	int start_of_file;
-};
-
 static void x_error_exit(j_common_ptr dinfo)
 {
 	struct x_error_mgr * err = (struct x_error_mgr *)dinfo->err;
@@ -728,75 +783,6 @@ static void x_emit_message(j_common_ptr dinfo, int msg_level)
 		err->num_warnings++;
 }
 
-static void init_source(j_decompress_ptr dinfo)
-{
-	struct x_source_mgr * src = (struct x_source_mgr *)dinfo->src;
-	src->start_of_file = 1;
-}
-
-static boolean fill_input_buffer(j_decompress_ptr dinfo)
-{
-	struct x_source_mgr * src = (struct x_source_mgr *)dinfo->src;
-	size_t nbytes;
-
-	nbytes = xfs_read(src->file, src->buffer, 4096);
-	if(nbytes <= 0)
-	{
-		if(src->start_of_file)
-			ERREXIT(dinfo, JERR_INPUT_EMPTY);
-		WARNMS(dinfo, JWRN_JPEG_EOF);
-		src->buffer[0] = (JOCTET)0xFF;
-		src->buffer[1] = (JOCTET)JPEG_EOI;
-		nbytes = 2;
-	}
-	src->pub.next_input_byte = src->buffer;
-	src->pub.bytes_in_buffer = nbytes;
-	src->start_of_file = 0;
-	return 1;
-}
-
-static void skip_input_data(j_decompress_ptr dinfo, long num_bytes)
-{
-	struct jpeg_source_mgr * src = dinfo->src;
-
-	if(num_bytes > 0)
-	{
-		while(num_bytes > (long)src->bytes_in_buffer)
-		{
-			num_bytes -= (long)src->bytes_in_buffer;
-			(void)(*src->fill_input_buffer)(dinfo);
-		}
-		src->next_input_byte += (size_t)num_bytes;
-		src->bytes_in_buffer -= (size_t)num_bytes;
-	}
-}
-
-static void term_source(j_decompress_ptr dinfo)
-{
-}
-
-static void jpeg_xfs_src(j_decompress_ptr dinfo, struct xfs_file_t * file)
-{
-	struct x_source_mgr * src;
-
-	if(dinfo->src == NULL)
-	{
-		dinfo->src = (struct jpeg_source_mgr *)(*dinfo->mem->alloc_small)((j_common_ptr)dinfo, JPOOL_PERMANENT, sizeof(struct x_source_mgr));
-		src = (struct x_source_mgr *)dinfo->src;
-		src->buffer = (JOCTET *)(*dinfo->mem->alloc_small)((j_common_ptr)dinfo, JPOOL_PERMANENT, 4096 * sizeof(JOCTET));
-	}
-
-	src = (struct x_source_mgr *)dinfo->src;
-	src->pub.init_source = init_source;
-	src->pub.fill_input_buffer = fill_input_buffer;
-	src->pub.skip_input_data = skip_input_data;
-	src->pub.resync_to_restart = jpeg_resync_to_restart;
-	src->pub.term_source = term_source;
-	src->file = file;
-	src->pub.bytes_in_buffer = 0;
-	src->pub.next_input_byte = NULL;
-}
-
 static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_t * ctx, const char * filename)
 {
 	struct jpeg_decompress_struct dinfo;
@@ -804,11 +790,16 @@ static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_
 	struct surface_t * s;
 	struct xfs_file_t * file;
 	JSAMPARRAY buf;
-	unsigned char * p;
+	unsigned char * p, * map;
 	int scanline, offset, i;
 
 	if(!(file = xfs_open_read(ctx, filename)))
 		return NULL;
+	if(!(map = xfs_map(file)))
+	{
+		xfs_close(file);
+		return NULL;
+	}
 	dinfo.err = jpeg_std_error(&jerr.pub);
 	jerr.pub.error_exit = x_error_exit;
 	jerr.pub.emit_message = x_emit_message;
@@ -819,7 +810,7 @@ static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_
 		return 0;
 	}
 	jpeg_create_decompress(&dinfo);
-	jpeg_xfs_src(&dinfo, file);
+	jpeg_mem_src(&dinfo, map, xfs_length(file));
 	jpeg_read_header(&dinfo, 1);
 	jpeg_start_decompress(&dinfo);
 	buf = (*dinfo.mem->alloc_sarray)((j_common_ptr)&dinfo, JPOOL_IMAGE, dinfo.output_width * dinfo.output_components, 1);
@@ -215,6 +215,190 @@ int ext4fs_node_sync(struct ext4fs_node_t * node)
 	return 0;
 }
 
+static int ext4fs_node_extent_add(struct ext4fs_node_t * node, u32_t lblk, u32_t len, u32_t pblk)
+{
+	struct ext4fs_extent_t * ext;
+	u32_t max;
+
+	if(node->extent_count >= node->extent_max)
+	{
+		max = node->extent_max ? node->extent_max << 1 : 4;
+		ext = realloc(node->extents, max * sizeof(struct ext4fs_extent_t));
+		if(!ext)
+		{
+			return -1;
+		}
+		node->extents = ext;
+		node->extent_max = max;
+	}
+
+	ext = &node->extents[node->extent_count++];
+	ext->lblk = lblk;
+	ext->len = len;
+	ext->pblk = pblk;
+
+	return 0;
+}
+
+static int ext4fs_node_extent_walk(struct ext4fs_node_t * node, struct ext4_extent_header_t * hdr, u32_t depth)
+{
+	struct ext4fs_control_t *ctrl = node->ctrl;
+	struct ext4_extent_t * ext;
+	struct ext4_extent_idx_t * idx;
+	u32_t i, entries, len, pblk;
+	u8_t * buf;
+	int rc = 0;
+
+	entries = le16_to_cpu(hdr->entries);
+	if((le16_to_cpu(hdr->magic) != EXT4_EXT_MAGIC) || (entries > le16_to_cpu(hdr->max)) || (le16_to_cpu(hdr->depth) != depth))
+	{
+		return -1;
+	}
+
+	if(depth == 0)
+	{
+		/* Leaf node, uninitialized extents read back as zero */
+		ext = (struct ext4_extent_t *)(hdr + 1);
+		for(i = 0; i < entries; i++)
+		{
+			if(le16_to_cpu(ext[i].start_hi))
+			{
+				return -1;
+			}
+			len = le16_to_cpu(ext[i].len);
+			if(len > EXT4_EXT_INIT_MAX_LEN)
+			{
+				len -= EXT4_EXT_INIT_MAX_LEN;
+				pblk = 0;
+			}
+			else
+			{
+				pblk = le32_to_cpu(ext[i].start_lo);
+			}
+			rc = ext4fs_node_extent_add(node, le32_to_cpu(ext[i].block), len, pblk);
+			if(rc)
+			{
+				return rc;
+			}
+		}
+		return 0;
+	}
+
+	/* Index node, descend into each child in logical order */
+	buf = malloc(ctrl->block_size);
+	if(!buf)
+	{
+		return -1;
+	}
+	idx = (struct ext4_extent_idx_t *)(hdr + 1);
+	for(i = 0; i < entries; i++)
+	{
+		if(le16_to_cpu(idx[i].leaf_hi))
+		{
+			rc = -1;
+			break;
+		}
+		rc = ext4fs_devread(ctrl, le32_to_cpu(idx[i].leaf_lo), 0, ctrl->block_size, (char *)buf);
+		if(rc)
+		{
+			break;
+		}
+		rc = ext4fs_node_extent_walk(node, (struct ext4_extent_header_t *)buf, depth - 1);
+		if(rc)
+		{
+			break;
+		}
+	}
+	free(buf);
+
+	return rc;
+}
+
+static int ext4fs_node_extent_load(struct ext4fs_node_t * node)
+{
+	struct ext4_extent_header_t * hdr = (struct ext4_extent_header_t *)node->inode.b.symlink;
+	int rc;
+
+	if(node->extents)
+	{
+		return 0;
+	}
+
+	if(le16_to_cpu(hdr->depth) > EXT4_EXT_MAX_DEPTH)
+	{
+		return -1;
+	}
+
+	node->extents = malloc(4 * sizeof(struct ext4fs_extent_t));
+	if(!node->extents)
+	{
+		return -1;
+	}
+	node->extent_count = 0;
+	node->extent_max = 4;
+
+	rc = ext4fs_node_extent_walk(node, hdr, le16_to_cpu(hdr->depth));
+	if(rc)
+	{
+		free(node->extents);
+		node->extents = NULL;
+		node->extent_count = 0;
+		node->extent_max = 0;
+		return rc;
+	}
+
+	return 0;
+}
+
+/*
+ * Map a logical block through the extent cache, holes and
+ * uninitialized extents return block zero. The number of blocks
+ * left in the run starting at blkpos is returned in blkcnt.
+ */
+static int ext4fs_node_extent_lookup(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno, u32_t * blkcnt)
+{
+	struct ext4fs_extent_t * ext;
+	u32_t l, r, m;
+	int rc;
+
+	rc = ext4fs_node_extent_load(node);
+	if(rc)
+	{
+		return rc;
+	}
+
+	l = 0;
+	r = node->extent_count;
+	while(l < r)
+	{
+		m = l + ((r - l) >> 1);
+		if(node->extents[m].lblk <= blkpos)
+		{
+			l = m + 1;
+		}
+		else
+		{
+			r = m;
+		}
+	}
+
+	if(l > 0)
+	{
+		ext = &node->extents[l - 1];
+		if(blkpos - ext->lblk < ext->len)
+		{
+			*blkno = ext->pblk ? ext->pblk + (blkpos - ext->lblk) : 0;
+			*blkcnt = ext->len - (blkpos - ext->lblk);
+			return 0;
+		}
+	}
+
+	*blkno = 0;
+	*blkcnt = (l < node->extent_count) ? node->extents[l].lblk - blkpos : 1;
+
+	return 0;
+}
+
 int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blkno)
 {
 	int rc;
@@ -222,7 +406,14 @@ int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blk
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
-	if(blkpos < ctrl->dir_blklast)
+	if(le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+	{
+		/* Extent tree.  */
+		u32_t blkcnt;
+
+		return ext4fs_node_extent_lookup(node, blkpos, blkno, &blkcnt);
+	}
+	else if(blkpos < ctrl->dir_blklast)
 	{
 		/* Direct blocks.  */
 		*blkno = le32_to_cpu(inode->b.blocks.dir_blocks[blkpos]);
@@ -310,6 +501,52 @@ int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blk
 	return 0;
 }
 
+/*
+ * Map blkpos and count the physically contiguous blocks that follow it, up
+ * to maxcnt. Extent inodes take the run from the extent, block mapped ones
+ * probe the following entries. The run is at least one block.
+ */
+int ext4fs_node_read_blkrun(struct ext4fs_node_t * node, u32_t blkpos, u32_t maxcnt, u32_t * blkno, u32_t * blkcnt)
+{
+	u32_t next;
+	int rc;
+
+	if(maxcnt < 1)
+	{
+		maxcnt = 1;
+	}
+
+	if(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+	{
+		rc = ext4fs_node_extent_lookup(node, blkpos, blkno, blkcnt);
+		if(rc)
+		{
+			return rc;
+		}
+		if(*blkcnt > maxcnt)
+		{
+			*blkcnt = maxcnt;
+		}
+		return 0;
+	}
+
+	rc = ext4fs_node_read_blkno(node, blkpos, blkno);
+	if(rc)
+	{
+		return rc;
+	}
+	*blkcnt = 1;
+	if(*blkno)
+	{
+		while((*blkcnt < maxcnt) && !ext4fs_node_read_blkno(node, blkpos + *blkcnt, &next) && (next == *blkno + *blkcnt))
+		{
+			(*blkcnt)++;
+		}
+	}
+
+	return 0;
+}
+
 int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blkno)
 {
 	int rc;
@@ -317,7 +554,19 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
-	if(blkpos < ctrl->dir_blklast)
+	if(le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+	{
+		/* Extent tree, only mapped blocks may be rewritten.  */
+		u32_t oblkno, blkcnt;
+
+		rc = ext4fs_node_extent_lookup(node, blkpos, &oblkno, &blkcnt);
+		if(rc)
+		{
+			return rc;
+		}
+		return (oblkno && (oblkno == blkno)) ? 0 : -1;
+	}
+	else if(blkpos < ctrl->dir_blklast)
 	{
 		/* Direct blocks.  */
 		inode->b.blocks.dir_blocks[blkpos] = le32_to_cpu(blkno);
@@ -427,7 +676,7 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 {
 	int rc;
 	u64_t filesize = ext4fs_node_get_size(node);
-	u32_t i, rlen, blkno, blkoff, blklen;
+	u32_t i, rlen, blkno, blkoff, blklen, blkcnt;
 	u32_t last_blkpos, last_blklen;
 	u32_t first_blkpos, first_blkoff, first_blklen;
 	struct ext4fs_control_t *ctrl = node->ctrl;
@@ -458,7 +707,7 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 	i = first_blkpos;
 	while(rlen)
 	{
-		rc = ext4fs_node_read_blkno(node, i, &blkno);
+		rc = ext4fs_node_read_blkrun(node, i, udiv32(rlen, ctrl->block_size), &blkno, &blkcnt);
 		if(rc)
 		{
 			goto done;
@@ -483,6 +732,32 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 			blklen = ctrl->block_size;
 		}
 
+		/* Read physically contiguous whole blocks in one transfer */
+		if(blkno && (blkoff == 0) && (blklen == ctrl->block_size))
+		{
+			if(blkcnt > 1)
+			{
+				if(node->cached_block && node->cached_dirty && (node->cached_blkno >= blkno) && (node->cached_blkno < blkno + blkcnt))
+				{
+					rc = ext4fs_devwrite(ctrl, node->cached_blkno, 0, ctrl->block_size, (char *)node->cached_block);
+					if(rc)
+					{
+						goto done;
+					}
+					node->cached_dirty = FALSE;
+				}
+				rc = ext4fs_devread(ctrl, blkno, 0, blkcnt * ctrl->block_size, buf);
+				if(rc)
+				{
+					goto done;
+				}
+				buf += blkcnt * ctrl->block_size;
+				rlen -= blkcnt * ctrl->block_size;
+				i += blkcnt;
+				continue;
+			}
+		}
+
 		/* Read cached block */
 		rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
 		if(rc)
@@ -526,6 +801,12 @@ u32_t ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char
 
 		if(!blkno)
 		{
+			/* Allocating inside an extent tree is not supported */
+			if(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+			{
+				goto done;
+			}
+
 			rc = ext4fs_control_alloc_block(ctrl, node->inode_no, &blkno);
 			if(rc)
 			{
@@ -621,6 +902,12 @@ int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
 		blkpos = first_blkpos;
 	}
 
+	/* Freeing blocks of an extent tree is not supported */
+	if((le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) && (blkpos < blkcnt))
+	{
+		return -1;
+	}
+
 	/* Free node blocks */
 	while(blkpos < blkcnt)
 	{
@@ -688,6 +975,14 @@ int ext4fs_node_load(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext4
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	if(node->extents)
+	{
+		free(node->extents);
+	}
+	node->extents = NULL;
+	node->extent_count = 0;
+	node->extent_max = 0;
+
 	return 0;
 }
 
@@ -714,6 +1009,10 @@ int ext4fs_node_init(struct ext4fs_node_t * node)
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	node->extents = NULL;
+	node->extent_count = 0;
+	node->extent_max = 0;
+
 	node->lookup_victim = 0;
 	for(idx = 0; idx < EXT4_NODE_LOOKUP_SIZE; idx++)
 	{
@@ -745,6 +1044,11 @@ int ext4fs_node_exit(struct ext4fs_node_t * node)
 		free(node->dindir2_block);
 	}
 
+	if(node->extents)
+	{
+		free(node->extents);
+	}
+
 	return 0;
 }
 
@@ -959,7 +1263,7 @@ int ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, str
 
 	if(!found)
 	{
-		return -1;
+		return ENOENT;
 	}
 
 	/* Add dent to lookup table */
@@ -362,7 +362,7 @@ static int ext4fs_create(struct vfs_node_t * dn, const char *name, u32_t mode)
 	struct ext4fs_node_t *dnode = dn->v_data;
 
 	rc = ext4fs_node_find_dirent(dnode, name, &dent);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 		{
@@ -457,7 +457,7 @@ static int ext4fs_rename(struct vfs_node_t * sv, const char * sname, struct vfs_
 	struct ext4fs_node_t *dnode = dn->v_data;
 
 	rc = ext4fs_node_find_dirent(dnode, dname, &dent);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 		{
@@ -502,7 +502,7 @@ static int ext4fs_mkdir(struct vfs_node_t * dn, const char *name, u32_t mode)
 	struct ext4fs_control_t *ctrl = dnode->ctrl;
 
 	rc = ext4fs_node_find_dirent(dnode, name, &dent);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 		{
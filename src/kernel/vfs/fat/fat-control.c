@@ -28,154 +28,128 @@
 
 #include <vfs/fat/fat-control.h>
 
-static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl, u32_t index)
+static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl, struct fatfs_fat_cache_t * c)
 {
-	u32_t i, sect_num;
+	u32_t i;
 	u64_t fat_base, len;
 
-	if(!ctrl->fat_cache_dirty[index])
+	if(!c->dirty)
 		return 0;
 
 	for(i = 0; i < ctrl->number_of_fat; i++)
 	{
 		fat_base = ((u64_t)ctrl->first_fat_sector + (i * ctrl->sectors_per_fat)) * ctrl->bytes_per_sector;
-		sect_num = ctrl->fat_cache_num[index];
-		len = block_write(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector,
-		        ctrl->bytes_per_sector);
+		len = block_write(ctrl->bdev, c->buf, fat_base + (u64_t)c->sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
 		if(len != ctrl->bytes_per_sector)
 			return -1;
 	}
-	ctrl->fat_cache_dirty[index] = FALSE;
+	c->dirty = FALSE;
 
 	return 0;
 }
 
-static int __fatfs_control_find_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
+static inline struct hlist_head * __fatfs_control_fat_cache_hash(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int index;
+	return &ctrl->fat_cache_hash[sect_num & (FAT_TABLE_CACHE_HASH - 1)];
+}
 
-	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
-	{
-		if(ctrl->fat_cache_num[index] == sect_num)
-			return index;
-	}
-	return -1;
+static void __fatfs_control_fat_cache_insert(struct fatfs_control_t * ctrl, struct fatfs_fat_cache_t * c, u32_t sect_num)
+{
+	if(!hlist_unhashed(&c->node))
+		hlist_del_init(&c->node);
+	c->sect_num = sect_num;
+	hlist_add_head(&c->node, __fatfs_control_fat_cache_hash(ctrl, sect_num));
 }
 
-static int __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
+static struct fatfs_fat_cache_t * __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int rc;
-	u32_t index;
+	struct fatfs_fat_cache_t * c;
 	u64_t fat_base, len;
 
-	if(-1 < __fatfs_control_find_fat_cache(ctrl, sect_num))
-		return 0;
-
-	index = ctrl->fat_cache_victim;
-	ctrl->fat_cache_victim++;
-	if(ctrl->fat_cache_victim == FAT_TABLE_CACHE_SIZE)
-		ctrl->fat_cache_victim = 0;
+	hlist_for_each_entry(c, __fatfs_control_fat_cache_hash(ctrl, sect_num), node)
+	{
+		if(c->sect_num == sect_num)
+		{
+			list_move(&c->lru, &ctrl->fat_cache_lru);
+			return c;
+		}
+	}
 
-	rc = __fatfs_control_flush_fat_cache(ctrl, index);
-	if(rc)
-		return rc;
+	c = list_last_entry(&ctrl->fat_cache_lru, struct fatfs_fat_cache_t, lru);
+	if(__fatfs_control_flush_fat_cache(ctrl, c))
+		return NULL;
+	if(!hlist_unhashed(&c->node))
+		hlist_del_init(&c->node);
 
-	fat_base = (u64_t) ctrl->first_fat_sector * ctrl->bytes_per_sector;
-	len = block_read(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
+	fat_base = (u64_t)ctrl->first_fat_sector * ctrl->bytes_per_sector;
+	len = block_read(ctrl->bdev, c->buf, fat_base + (u64_t)sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
 	if(len != ctrl->bytes_per_sector)
-		return -1;
-	ctrl->fat_cache_num[index] = sect_num;
+		return NULL;
+	__fatfs_control_fat_cache_insert(ctrl, c, sect_num);
+	list_move(&c->lru, &ctrl->fat_cache_lru);
 
-	return 0;
+	return c;
 }
 
-static u32_t __fatfs_control_read_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+/*
+ * Access a FAT entry of len bytes at byte offset pos, FAT12 entries
+ * may straddle two sectors.
+ */
+static u32_t __fatfs_control_access_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos, u32_t len, bool_t write)
 {
-	int rc, index;
-	u32_t ret, sect_num, sect_off;
+	struct fatfs_fat_cache_t * c = NULL;
+	u32_t i, sect_num, sect_off;
 
-	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
+	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) < pos + len)
 		return 0;
 
-	sect_num = udiv32(pos, ctrl->bytes_per_sector);
-	sect_off = pos - (sect_num * ctrl->bytes_per_sector);
-
-	rc = __fatfs_control_load_fat_cache(ctrl, sect_num);
-	if(rc)
-		return 0;
-
-	index = __fatfs_control_find_fat_cache(ctrl, sect_num);
-	if(index < 0)
-		return 0;
+	for(i = 0; i < len; i++)
+	{
+		sect_num = udiv32(pos + i, ctrl->bytes_per_sector);
+		sect_off = pos + i - (sect_num * ctrl->bytes_per_sector);
+		if(!c || (c->sect_num != sect_num))
+		{
+			c = __fatfs_control_load_fat_cache(ctrl, sect_num);
+			if(!c)
+				return 0;
+		}
+		if(write)
+		{
+			c->buf[sect_off] = buf[i];
+			c->dirty = TRUE;
+		}
+		else
+		{
+			buf[i] = c->buf[sect_off];
+		}
+	}
 
-	index = (index * ctrl->bytes_per_sector) + sect_off;
+	return len;
+}
 
+static u32_t __fatfs_control_fat_entry_len(struct fatfs_control_t * ctrl)
+{
 	switch(ctrl->type)
 	{
 	case FAT_TYPE_12:
 	case FAT_TYPE_16:
-		ret = 2;
-		buf[0] = ctrl->fat_cache_buf[index + 0];
-		buf[1] = ctrl->fat_cache_buf[index + 1];
-		break;
+		return 2;
 	case FAT_TYPE_32:
-		ret = 4;
-		buf[0] = ctrl->fat_cache_buf[index + 0];
-		buf[1] = ctrl->fat_cache_buf[index + 1];
-		buf[2] = ctrl->fat_cache_buf[index + 2];
-		buf[3] = ctrl->fat_cache_buf[index + 3];
-		break;
+		return 4;
 	default:
-		ret = 0;
 		break;
 	};
+	return 0;
+}
 
-	return ret;
+static u32_t __fatfs_control_read_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+{
+	return __fatfs_control_access_fat_cache(ctrl, buf, pos, __fatfs_control_fat_entry_len(ctrl), FALSE);
 }
 
 static u32_t __fatfs_control_write_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
 {
-	int rc, index, cache_buf_index;
-	u32_t ret, sect_num, sect_off;
-
-	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
-		return 0;
-
-	sect_num = udiv32(pos, ctrl->bytes_per_sector);
-	sect_off = pos - (sect_num * ctrl->bytes_per_sector);
-
-	rc = __fatfs_control_load_fat_cache(ctrl, sect_num);
-	if(rc)
-		return 0;
-
-	index = __fatfs_control_find_fat_cache(ctrl, sect_num);
-	if(index < 0)
-		return 0;
-
-	cache_buf_index = (index * ctrl->bytes_per_sector) + sect_off;
-
-	switch(ctrl->type)
-	{
-	case FAT_TYPE_12:
-	case FAT_TYPE_16:
-		ret = 2;
-		ctrl->fat_cache_buf[cache_buf_index + 0] = buf[0];
-		ctrl->fat_cache_buf[cache_buf_index + 1] = buf[1];
-		break;
-	case FAT_TYPE_32:
-		ret = 4;
-		ctrl->fat_cache_buf[cache_buf_index + 0] = buf[0];
-		ctrl->fat_cache_buf[cache_buf_index + 1] = buf[1];
-		ctrl->fat_cache_buf[cache_buf_index + 2] = buf[2];
-		ctrl->fat_cache_buf[cache_buf_index + 3] = buf[3];
-		break;
-	default:
-		ret = 0;
-		break;
-	};
-	ctrl->fat_cache_dirty[index] = TRUE;
-
-	return ret;
+	return __fatfs_control_access_fat_cache(ctrl, buf, pos, __fatfs_control_fat_entry_len(ctrl), TRUE);
 }
 
 static u32_t __fatfs_control_first_valid_cluster(struct fatfs_control_t * ctrl)
@@ -616,7 +590,7 @@ int fatfs_control_sync(struct fatfs_control_t * ctrl)
 	mutex_lock(&ctrl->fat_cache_lock);
 	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
 	{
-		rc = __fatfs_control_flush_fat_cache(ctrl, index);
+		rc = __fatfs_control_flush_fat_cache(ctrl, &ctrl->fat_cache[index]);
 		if(rc)
 		{
 			mutex_unlock(&ctrl->fat_cache_lock);
@@ -633,7 +607,7 @@ int fatfs_control_sync(struct fatfs_control_t * ctrl)
 
 int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
 {
-	u32_t i;
+	u32_t i, count;
 	u64_t rlen;
 	struct fat_bootsec_t *bsec = &ctrl->bsec;
 
@@ -720,24 +694,32 @@ int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
 
 	/* Initialize fat cache */
 	mutex_init(&ctrl->fat_cache_lock);
-	ctrl->fat_cache_victim = 0;
-	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
-	{
-		ctrl->fat_cache_dirty[i] = FALSE;
-		ctrl->fat_cache_num[i] = i;
-	}
+	for(i = 0; i < FAT_TABLE_CACHE_HASH; i++)
+		init_hlist_head(&ctrl->fat_cache_hash[i]);
+	init_list_head(&ctrl->fat_cache_lru);
 	ctrl->fat_cache_buf = calloc(1, FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
 	if(!ctrl->fat_cache_buf)
 		return -1;
+	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
+	{
+		init_hlist_node(&ctrl->fat_cache[i].node);
+		ctrl->fat_cache[i].sect_num = 0;
+		ctrl->fat_cache[i].dirty = FALSE;
+		ctrl->fat_cache[i].buf = &ctrl->fat_cache_buf[i * ctrl->bytes_per_sector];
+		list_add_tail(&ctrl->fat_cache[i].lru, &ctrl->fat_cache_lru);
+	}
 
-	/* Load fat cache */
-	rlen = block_read(ctrl->bdev, ctrl->fat_cache_buf, ctrl->first_fat_sector * ctrl->bytes_per_sector,
-	FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
-	if(rlen != (FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector))
+	/* Load the head of the fat in one transfer */
+	count = (ctrl->sectors_per_fat < FAT_TABLE_CACHE_SIZE) ? ctrl->sectors_per_fat : FAT_TABLE_CACHE_SIZE;
+	rlen = block_read(ctrl->bdev, ctrl->fat_cache_buf, (u64_t)ctrl->first_fat_sector * ctrl->bytes_per_sector,
+	count * ctrl->bytes_per_sector);
+	if(rlen != (count * ctrl->bytes_per_sector))
 	{
 		free(ctrl->fat_cache_buf);
 		return -1;
 	}
+	for(i = 0; i < count; i++)
+		__fatfs_control_fat_cache_insert(ctrl, &ctrl->fat_cache[i], i);
 
 	return 0;
 }
@@ -170,73 +170,180 @@ static int fatfs_node_clear_cluster(struct fatfs_node_t * node, u32_t clust)
 	return 0;
 }
 
-static int fatfs_node_nth_cluster(struct fatfs_node_t * node, u32_t clust, u32_t pos, u32_t * next)
+static void fatfs_node_map_reset(struct fatfs_node_t * node)
 {
-	return fatfs_control_nth_cluster(node->ctrl, clust, pos, next);
+	node->map_count = 0;
+	node->map_first = 0;
+	node->map_clusters = 0;
 }
 
-static int fatfs_node_next_cluster(struct fatfs_node_t * node, u32_t clust, u32_t * next)
+static int fatfs_node_map_add(struct fatfs_node_t * node, u32_t clust)
 {
-	return fatfs_node_nth_cluster(node, clust, 1, next);
+	struct fatfs_extent_t * e;
+	u32_t max;
+
+	if(node->map_count > 0)
+	{
+		e = &node->map[node->map_count - 1];
+		if(e->clust + e->len == clust)
+		{
+			e->len++;
+			node->map_clusters++;
+			return 0;
+		}
+	}
+
+	if(node->map_count >= node->map_max)
+	{
+		max = node->map_max ? node->map_max << 1 : 8;
+		e = realloc(node->map, max * sizeof(struct fatfs_extent_t));
+		if(!e)
+			return -1;
+		node->map = e;
+		node->map_max = max;
+	}
+
+	e = &node->map[node->map_count++];
+	e->pos = node->map_clusters;
+	e->clust = clust;
+	e->len = 1;
+	node->map_clusters++;
+
+	return 0;
 }
 
-static int fatfs_node_auto_alloc_next_cluster(struct fatfs_node_t * node, u32_t clust, u32_t * next)
+/*
+ * Walk the cluster chain once and record it as runs of contiguous
+ * clusters. The map stays valid until the chain is truncated or the
+ * first cluster changes, appends extend it in place.
+ */
+static int fatfs_node_map_load(struct fatfs_node_t * node)
 {
-	int rc;
 	struct fatfs_control_t * ctrl = node->ctrl;
-	u32_t cl = clust;
+	u32_t clust;
 
-	/* Go to next cluster */
-	rc = fatfs_node_next_cluster(node, clust, next);
-	if(!rc)
+	if(node->map_first == node->first_cluster)
 		return 0;
 
-	/* Add new cluster */
-	if(fatfs_control_valid_cluster(ctrl, clust))
+	fatfs_node_map_reset(node);
+	clust = node->first_cluster;
+	while(fatfs_control_valid_cluster(ctrl, clust) && (node->map_clusters < ctrl->data_clusters))
 	{
-		rc = fatfs_control_append_free_cluster(ctrl, cl, next);
+		if(fatfs_node_map_add(node, clust))
+		{
+			fatfs_node_map_reset(node);
+			return -1;
+		}
+		if(fatfs_control_nth_cluster(ctrl, clust, 1, &clust))
+			break;
 	}
-	else
+	node->map_first = node->first_cluster;
+
+	return 0;
+}
+
+static void fatfs_node_map_append(struct fatfs_node_t * node, u32_t clust)
+{
+	if(node->map_count == 0)
+	{
+		if(node->map_first != node->first_cluster)
+			return;
+		node->map_first = clust;
+	}
+	else if(node->map_first != node->first_cluster)
 	{
-		rc = fatfs_control_alloc_first_cluster(ctrl, next);
+		return;
 	}
 
-	if(rc)
-		return rc;
+	if(fatfs_node_map_add(node, clust))
+		fatfs_node_map_reset(node);
+}
 
-	rc = fatfs_node_clear_cluster(node, *next);
+/*
+ * Map a cluster index of the chain to its cluster number, run returns
+ * how many physically contiguous clusters follow from there.
+ */
+static int fatfs_node_map_cluster(struct fatfs_node_t * node, u32_t pos, u32_t * clust, u32_t * run)
+{
+	struct fatfs_extent_t * e;
+	u32_t l, r, m;
 
-	if(rc)
-		return rc;
+	if(fatfs_node_map_load(node))
+		return -1;
+
+	if(pos >= node->map_clusters)
+		return -1;
+
+	l = 0;
+	r = node->map_count;
+	while(l + 1 < r)
+	{
+		m = l + ((r - l) >> 1);
+		if(node->map[m].pos <= pos)
+			l = m;
+		else
+			r = m;
+	}
+	e = &node->map[l];
+	*clust = e->clust + (pos - e->pos);
+	if(run)
+		*run = e->len - (pos - e->pos);
 
 	return 0;
 }
 
-static void fatfs_node_fast_jump_cluster(struct fatfs_node_t * node, u32_t pos, u32_t * cl_pos, u32_t * cl_num)
+/*
+ * Append count clusters to the chain. Each allocation searches from the
+ * previous cluster, so appends come out as contiguous runs whenever the
+ * space after the chain is free.
+ */
+static int fatfs_node_grow(struct fatfs_node_t * node, u32_t count)
 {
-	struct fatfs_control_t *ctrl = node->ctrl;
+	struct fatfs_control_t * ctrl = node->ctrl;
+	u32_t last, clust;
+	int rc;
 
-	node->cur_pos = ctrl->bytes_per_cluster * udiv32(node->cur_pos, ctrl->bytes_per_cluster);
+	if(fatfs_node_map_load(node))
+		return -1;
 
-	/* Jump to current pos if pos >= cur_cluster*/
-	if(pos >= node->cur_pos)
+	if(node->map_clusters == 0)
 	{
-		*cl_pos = udiv32(pos - node->cur_pos, ctrl->bytes_per_cluster);
-		*cl_num = node->cur_cluster;
+		rc = fatfs_control_alloc_first_cluster(ctrl, &clust);
+		if(rc)
+			return rc;
+		fatfs_node_map_append(node, clust);
+		node->first_cluster = clust;
+		node->cur_cluster = clust;
+		node->cur_pos = 0;
+
+		/* Mark node directory entry as dirty */
+		node->parent_dent_dirty = TRUE;
+		count--;
 	}
-	else
+
+	while(count--)
 	{
-		*cl_pos = udiv32(pos, ctrl->bytes_per_cluster);
-		*cl_num = node->first_cluster;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
+		rc = fatfs_node_map_cluster(node, node->map_clusters - 1, &last, NULL);
+		if(rc)
+			return rc;
+		rc = fatfs_control_append_free_cluster(ctrl, last, &clust);
+		if(rc)
+			return rc;
+		fatfs_node_map_append(node, clust);
 	}
+
+	return 0;
+}
+
+static u64_t fatfs_node_cluster_offset(struct fatfs_control_t * ctrl, u32_t clust)
+{
+	return (u64_t)ctrl->first_data_sector * ctrl->bytes_per_sector + (u64_t)(clust - 2) * ctrl->bytes_per_cluster;
 }
 
 u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
 	u64_t roff, rlen;
-	u32_t r, rstartcl;
+	u32_t r, idx, run, cnt;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -254,45 +361,59 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		return block_read(ctrl->bdev, (u8_t *) buf, roff, rlen);
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &rstartcl, &cl_num);
-
-	if(fatfs_node_nth_cluster(node, cl_num, rstartcl, &cl_num))
-		return 0;
-
 	r = 0;
-	cl_off = umod32(pos + r, ctrl->bytes_per_cluster);
-	do
+	idx = udiv32(pos, ctrl->bytes_per_cluster);
+	cl_off = pos - idx * ctrl->bytes_per_cluster;
+	while(r < len)
 	{
-		/* Current cluster info */
-		cl_len = ctrl->bytes_per_cluster - cl_off;
-		cl_len = (len - r < cl_len) ? len - r : cl_len;
+		if(fatfs_node_map_cluster(node, idx, &cl_num, &run))
+			break;
 
 		/* Update current cluster */
 		node->cur_cluster = cl_num;
 		node->cur_pos = pos + r;
 
-		/* Read from cached cluster */
-		rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
-
-		if(rlen != cl_len)
+		if((cl_off == 0) && (len - r >= ctrl->bytes_per_cluster))
 		{
-			break;
+			/* Read contiguous whole clusters straight into the buffer */
+			cnt = udiv32(len - r, ctrl->bytes_per_cluster);
+			if(cnt > run)
+				cnt = run;
+			cl_len = cnt * ctrl->bytes_per_cluster;
+			if(node->cached_dirty && (node->cached_clust >= cl_num) && (node->cached_clust < cl_num + cnt))
+			{
+				if(fatfs_node_sync_cached_cluster(node))
+					break;
+			}
+			rlen = block_read(ctrl->bdev, buf, fatfs_node_cluster_offset(ctrl, cl_num), cl_len);
+			if(rlen != cl_len)
+				break;
+			idx += cnt;
+		}
+		else
+		{
+			/* Read from cached cluster */
+			cl_len = ctrl->bytes_per_cluster - cl_off;
+			cl_len = (len - r < cl_len) ? len - r : cl_len;
+			rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
+			if(rlen != cl_len)
+				break;
+			idx++;
 		}
 
 		/* Update iteration */
 		r += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(r < len && !fatfs_node_next_cluster(node, cl_num, &cl_num));
+		cl_off = 0;
+	}
 
 	return r;
 }
 
 u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
-	int rc;
 	u64_t woff, wlen;
-	u32_t w = 0, wstartcl;
+	u32_t w, idx, last, old, run, cnt;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -308,56 +429,80 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 		return block_write(ctrl->bdev, (u8_t *) buf, woff, wlen);
 	}
 
-	/* If first cluster is zero then allocate first cluster */
-	if(node->first_cluster == 0)
+	if(len == 0)
+		return 0;
+
+	/* Make room for new data by appending free clusters in one go,
+	 * on failure drop whatever was appended and write what still fits
+	 */
+	if(fatfs_node_map_load(node))
+		return 0;
+	old = node->map_clusters;
+	last = udiv32(pos + len - 1, ctrl->bytes_per_cluster);
+	if((last >= old) && fatfs_node_grow(node, last + 1 - old))
 	{
-		rc = fatfs_node_auto_alloc_next_cluster(node, 0, &cl_num);
-		if(rc)
+		if(fatfs_node_truncate(node, old * ctrl->bytes_per_cluster))
 			return 0;
-
-		node->first_cluster = cl_num;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
-
-		/* Mark node directory entry as dirty */
-		node->parent_dent_dirty = TRUE;
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &wstartcl, &cl_num);
-
-	/* Make room for new data by appending free clusters */
-	for(int i = 0; i < wstartcl; i++)
+	/* Zero fill clusters between the old end and the write position */
+	idx = udiv32(pos, ctrl->bytes_per_cluster);
+	for(w = old; w < idx; w++)
 	{
-		rc = fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num);
-		if(rc)
+		if(fatfs_node_map_cluster(node, w, &cl_num, NULL) || fatfs_node_clear_cluster(node, cl_num))
 			return 0;
+		node->cached_dirty = TRUE;
 	}
 
 	w = 0;
-	cl_off = umod32(pos + w, ctrl->bytes_per_cluster);
-	do
+	cl_off = pos - idx * ctrl->bytes_per_cluster;
+	while(w < len)
 	{
-		/* Current cluster info */
-		cl_len = ctrl->bytes_per_cluster - cl_off;
-		cl_len = (len - w < cl_len) ? len - w : cl_len;
+		if(fatfs_node_map_cluster(node, idx, &cl_num, &run))
+			break;
 
 		/* Update current cluster */
 		node->cur_cluster = cl_num;
 		node->cur_pos = pos + w;
 
-		/* Write next cluster */
-		wlen = fatfs_node_write_cluster(node, cl_num, buf, cl_off, cl_len);
-
-		if(wlen != cl_len)
+		if((cl_off == 0) && (len - w >= ctrl->bytes_per_cluster))
 		{
-			break;
+			/* Write contiguous whole clusters straight from the buffer */
+			cnt = udiv32(len - w, ctrl->bytes_per_cluster);
+			if(cnt > run)
+				cnt = run;
+			cl_len = cnt * ctrl->bytes_per_cluster;
+			if((node->cached_clust >= cl_num) && (node->cached_clust < cl_num + cnt))
+			{
+				node->cached_clust = 0;
+				node->cached_dirty = FALSE;
+			}
+			wlen = block_write(ctrl->bdev, buf, fatfs_node_cluster_offset(ctrl, cl_num), cl_len);
+			if(wlen != cl_len)
+				break;
+			idx += cnt;
+		}
+		else
+		{
+			/* Write through cached cluster, new clusters start zeroed */
+			cl_len = ctrl->bytes_per_cluster - cl_off;
+			cl_len = (len - w < cl_len) ? len - w : cl_len;
+			if((idx >= old) && (node->cached_clust != cl_num))
+			{
+				if(fatfs_node_clear_cluster(node, cl_num))
+					break;
+			}
+			wlen = fatfs_node_write_cluster(node, cl_num, buf, cl_off, cl_len);
+			if(wlen != cl_len)
+				break;
+			idx++;
 		}
 
 		/* Update iteration */
 		w += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(w < len && !fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num));
+		cl_off = 0;
+	}
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
@@ -368,7 +513,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 {
 	int rc;
-	u32_t cl_pos, cl_num, t_pos;
+	u32_t keep, last, next;
 	struct fatfs_control_t * ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -377,38 +522,29 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 		return 0;
 	}
 
-	/* Determine last cluster after truncation */
-	t_pos = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
-	fatfs_node_fast_jump_cluster(node, t_pos + ctrl->bytes_per_cluster - 1, &cl_pos, &cl_num);
-
-	rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
-	if(rc)
-		return rc;
-
-	/* Remove all clusters after last cluster */
-	rc = fatfs_control_truncate_clusters(ctrl, cl_num);
-	if(rc)
-		return rc;
+	/* Number of clusters left after truncation */
+	keep = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
 
 	/* If we are removing first cluster then set it to zero
-	 * else set previous cluster as last cluster
+	 * else set last kept cluster as last cluster
 	 */
-	if(cl_pos == 0)
+	if(keep == 0)
 	{
+		rc = fatfs_control_truncate_clusters(ctrl, node->first_cluster);
+		if(rc)
+			return rc;
 		node->first_cluster = 0;
 	}
-	else
+	else if(!fatfs_node_map_cluster(node, keep - 1, &last, NULL) && !fatfs_node_map_cluster(node, keep, &next, NULL))
 	{
-		/* if go here, t_pos >= node->first_cluster */
-		t_pos -= ctrl->bytes_per_cluster;
-		fatfs_node_fast_jump_cluster(node, t_pos, &cl_pos, &cl_num);
-		rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
+		rc = fatfs_control_truncate_clusters(ctrl, next);
 		if(rc)
 			return rc;
-		rc = fatfs_control_set_last_cluster(ctrl, cl_num);
+		rc = fatfs_control_set_last_cluster(ctrl, last);
 		if(rc)
 			return rc;
 	}
+	fatfs_node_map_reset(node);
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
@@ -444,6 +580,12 @@ int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node)
 	node->cur_cluster = 0;
 	node->cur_pos = 0;
 
+	node->map = NULL;
+	node->map_count = 0;
+	node->map_max = 0;
+	node->map_first = 0;
+	node->map_clusters = 0;
+
 	node->cached_clust = 0;
 	node->cached_data = NULL;
 	node->cached_dirty = FALSE;
@@ -462,6 +604,14 @@ int fatfs_node_exit(struct fatfs_node_t * node)
 		node->cached_dirty = FALSE;
 	}
 
+	if(node->map)
+	{
+		free(node->map);
+		node->map = NULL;
+		node->map_count = 0;
+		node->map_max = 0;
+	}
+
 	return 0;
 }
 
@@ -620,7 +770,7 @@ int fatfs_node_find_dirent(struct fatfs_node_t * dnode, const char * name, struc
 			return -1;
 
 		if(dent->dos_file_name[0] == 0x0)
-			return -1;
+			return ENOENT;
 
 		off += sizeof(struct fat_dirent_t);
 
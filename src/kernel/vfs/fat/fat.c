@@ -334,7 +334,7 @@ static int fatfs_create(struct vfs_node_t * dn, const char * name, u32_t mode)
 	struct fatfs_node_t *dnode = dn->v_data;
 
 	rc = fatfs_node_find_dirent(dnode, name, &dent, &off, &len);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 			return -1;
@@ -421,7 +421,7 @@ static int fatfs_rename(struct vfs_node_t * sv, const char *sname, struct vfs_no
 	struct fatfs_node_t *dnode = dn->v_data;
 
 	rc = fatfs_node_find_dirent(dnode, dname, &dent, &off, &len);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 			return -1;
@@ -454,7 +454,7 @@ static int fatfs_mkdir(struct vfs_node_t * dn, const char *name, u32_t mode)
 	struct fatfs_node_t *dnode = dn->v_data;
 
 	rc = fatfs_node_find_dirent(dnode, name, &dent, &off, &len);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 			return -1;
@@ -171,6 +171,15 @@ static u64_t ram_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 	return sz;
 }
 
+static void * ram_mmap(struct vfs_node_t * n, s64_t off, u64_t len)
+{
+	struct ram_node_t * rn = n->v_data;
+
+	if(!rn->buf || (off + len > rn->size))
+		return NULL;
+	return rn->buf + off;
+}
+
 static u64_t ram_write(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
 	struct ram_node_t * rn;
@@ -303,7 +312,7 @@ static int ram_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node
 			return 0;
 		}
 	}
-	return -1;
+	return ENOENT;
 }
 
 static int ram_create(struct vfs_node_t * dn, const char * name, u32_t mode)
@@ -392,6 +401,7 @@ static struct filesystem_t ram = {
 
 	.read		= ram_read,
 	.write		= ram_write,
+	.mmap		= ram_mmap,
 	.truncate	= ram_truncate,
 	.sync		= ram_sync,
 	.readdir	= ram_readdir,
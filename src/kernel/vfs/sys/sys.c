@@ -202,6 +202,7 @@ static int sys_chmod(struct vfs_node_t * n, u32_t mode)
 
 static struct filesystem_t sys = {
 	.name		= "sys",
+	.flags		= FS_NOCACHE,
 
 	.mount		= sys_mount,
 	.unmount	= sys_unmount,
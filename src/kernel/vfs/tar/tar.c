@@ -342,7 +342,7 @@ static int tar_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node
 			return -1;
 
 		if(strncmp((const char *)(header.magic), "ustar", 5) != 0)
-			return -1;
+			return ENOENT;
 
 		size = strtoull((const char *)(header.size), NULL, 0);
 		if(size < 0)
@@ -34,6 +34,7 @@ struct list_head __filesystem_list = {
 	.prev = &__filesystem_list,
 };
 static spinlock_t __filesystem_lock = SPIN_LOCK_INIT();
+static struct kmem_cache_t * __vfs_node_cache = NULL;
 
 static struct kobj_t * search_class_filesystem_kobj(void)
 {
@@ -104,57 +105,149 @@ static struct mutex_t mnt_list_lock;
 static struct vfs_file_t fd_file[VFS_MAX_FD];
 static struct mutex_t fd_file_lock;
 struct list_head node_list[VFS_NODE_HASH_SIZE];
-static struct mutex_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct rwlock_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct list_head node_lru;
+static spinlock_t node_lru_lock;
+static int node_lru_count;
 
-static int count_match(const char * path, char * mount_root)
+/*
+ * Mount points are indexed by a trie of path components. Readers walk it
+ * without locking and retry if a mount or unmount raced with them. Trie
+ * nodes are never freed, unmount only clears the mount pointer, so a
+ * racing reader never touches released memory.
+ */
+struct mnt_trie_t {
+	struct list_head entry;
+	struct list_head child;
+	struct vfs_mount_t * mount;
+	int len;
+	char name[VFS_MAX_NAME];
+};
+
+static struct mnt_trie_t mnt_trie;
+static seqlock_t mnt_trie_lock;
+
+static struct mnt_trie_t * mnt_trie_child(struct mnt_trie_t * t, const char * name, int len)
+{
+	struct mnt_trie_t * c;
+
+	list_for_each_entry(c, &t->child, entry)
+	{
+		if((c->len == len) && !strncmp(c->name, name, len))
+			return c;
+	}
+	return NULL;
+}
+
+static struct mnt_trie_t * mnt_trie_walk(const char * path, int create)
 {
-	int len = 0;
+	struct mnt_trie_t * t = &mnt_trie, * c;
+	const char * p = path, * q;
+	int len;
 
-	while(*path && *mount_root)
+	while(1)
 	{
-		if(*path != *mount_root)
+		while(*p == '/')
+			p++;
+		if(*p == '\0')
 			break;
-		path++;
-		mount_root++;
-		len++;
+		for(q = p; *q != '\0' && *q != '/'; q++);
+		len = q - p;
+		if(len >= VFS_MAX_NAME)
+			return NULL;
+		c = mnt_trie_child(t, p, len);
+		if(!c)
+		{
+			if(!create)
+				return NULL;
+			if(!(c = calloc(1, sizeof(struct mnt_trie_t))))
+				return NULL;
+			init_list_head(&c->child);
+			c->mount = NULL;
+			c->len = len;
+			memcpy(c->name, p, len);
+			c->name[len] = '\0';
+
+			/* Publish only a complete entry to lock-free readers */
+			write_seqlock(&mnt_trie_lock);
+			c->entry.next = &t->child;
+			c->entry.prev = t->child.prev;
+			smp_wmb();
+			t->child.prev->next = &c->entry;
+			t->child.prev = &c->entry;
+			write_sequnlock(&mnt_trie_lock);
+		}
+		t = c;
+		p = q;
 	}
+	return t;
+}
 
-	if(*mount_root != '\0')
-		return 0;
+static int mnt_trie_add(struct vfs_mount_t * m)
+{
+	struct mnt_trie_t * t;
 
-	if((len == 1) && (*(path - 1) == '/'))
-		return 1;
+	t = mnt_trie_walk(m->m_path, 1);
+	if(!t || t->mount)
+		return -1;
 
-	if((*path == '\0') || (*path == '/'))
-		return len;
+	write_seqlock(&mnt_trie_lock);
+	t->mount = m;
+	write_sequnlock(&mnt_trie_lock);
 
 	return 0;
 }
 
+static void mnt_trie_del(struct vfs_mount_t * m)
+{
+	struct mnt_trie_t * t;
+
+	t = mnt_trie_walk(m->m_path, 0);
+	if(t && (t->mount == m))
+	{
+		write_seqlock(&mnt_trie_lock);
+		t->mount = NULL;
+		write_sequnlock(&mnt_trie_lock);
+	}
+}
+
 static int vfs_findroot(const char * path, struct vfs_mount_t ** mp, char ** root)
 {
-	struct vfs_mount_t * pos, * m = NULL;
-	int len, max_len = 0;
+	struct mnt_trie_t * t;
+	struct vfs_mount_t * m;
+	const char * p, * q, * end;
+	unsigned int seq;
 
-	if(!path || !mp || !root)
+	if(!path || !mp || !root || (*path != '/'))
 		return -1;
 
-	mutex_lock(&mnt_list_lock);
-	list_for_each_entry(pos, &mnt_list, m_link)
-	{
-		len = count_match(path, pos->m_path);
-		if(len > max_len)
+	do {
+		seq = read_seqbegin(&mnt_trie_lock);
+		t = &mnt_trie;
+		m = t->mount;
+		end = p = path;
+		while(1)
 		{
-			max_len = len;
-			m = pos;
+			while(*p == '/')
+				p++;
+			if(*p == '\0')
+				break;
+			for(q = p; *q != '\0' && *q != '/'; q++);
+			if(!(t = mnt_trie_child(t, p, q - p)))
+				break;
+			p = q;
+			if(t->mount)
+			{
+				m = t->mount;
+				end = p;
+			}
 		}
-	}
-	mutex_unlock(&mnt_list_lock);
+	} while(read_seqretry(&mnt_trie_lock, seq));
 
 	if(!m)
 		return -1;
 
-	*root = (char *)(path + max_len);
+	*root = (char *)end;
 	while(**root == '/')
 	{
 		(*root)++;
@@ -213,25 +306,163 @@ static u32_t vfs_node_hash(struct vfs_mount_t * m, const char * path)
 		while(*path)
 			val = ((val << 5) + val) + *path++;
 	}
-	return (val ^ (u32_t)((unsigned long)m)) & (VFS_NODE_HASH_SIZE - 1);
+	return val ^ (u32_t)((unsigned long)m);
+}
+
+static void __vfs_node_put(struct vfs_node_t * n);
+
+static void vfs_node_ref(struct vfs_node_t * n)
+{
+	atomic_add(&n->v_refcnt, 1);
+}
+
+static void vfs_node_destroy(struct vfs_node_t * n)
+{
+	struct vfs_node_t * parent = n->v_parent;
+
+	mutex_lock(&n->v_mount->m_lock);
+	n->v_mount->m_fs->vput(n->v_mount, n);
+	mutex_unlock(&n->v_mount->m_lock);
+
+	atomic_sub(&n->v_mount->m_refcnt, 1);
+	kmem_cache_free(__vfs_node_cache, n);
+
+	if(parent)
+		__vfs_node_put(parent);
 }
 
-static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * path)
+/*
+ * Unreferenced nodes are kept on the lru list and stay in the hash, so
+ * that reopening a path or probing a missing one does not go back to the
+ * filesystem. Every node holds a reference on its parent, so a cached
+ * directory outlives the cached entries below it. Filesystems whose tree
+ * changes behind the vfs, such as sys, set FS_NOCACHE and drop nodes at
+ * once. A reference count of -1 marks a node being evicted, it can no
+ * longer be found.
+ */
+static void vfs_node_evict(void)
+{
+	struct vfs_node_t * n;
+	u32_t hash;
+
+	while(1)
+	{
+		spin_lock(&node_lru_lock);
+		if(node_lru_count <= VFS_NODE_CACHE_SIZE)
+		{
+			spin_unlock(&node_lru_lock);
+			break;
+		}
+		n = list_last_entry(&node_lru, struct vfs_node_t, v_lru);
+		list_del_init(&n->v_lru);
+		node_lru_count--;
+		if(atomic_cmpxchg(&n->v_refcnt, 0, -1) != 0)
+			n = NULL;
+		spin_unlock(&node_lru_lock);
+
+		if(n)
+		{
+			hash = n->v_hash & (VFS_NODE_HASH_SIZE - 1);
+			rwlock_write_lock(&node_list_lock[hash]);
+			list_del(&n->v_link);
+			rwlock_write_unlock(&node_list_lock[hash]);
+			vfs_node_destroy(n);
+		}
+	}
+}
+
+/*
+ * Drop unreferenced nodes of a mount, either all of them or the given
+ * node path with everything below it. Parents only become unreferenced
+ * once their children are gone, so repeat until nothing is left.
+ */
+static void vfs_node_purge(struct vfs_mount_t * m, const char * path)
+{
+	struct vfs_node_t * n, * t;
+	struct list_head kill;
+	int i, len = path ? strlen(path) : 0;
+
+again:
+	init_list_head(&kill);
+	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
+	{
+		rwlock_write_lock(&node_list_lock[i]);
+		list_for_each_entry_safe(n, t, &node_list[i], v_link)
+		{
+			if(n->v_mount != m)
+				continue;
+			if(path && (strncmp(n->v_path, path, len) || ((n->v_path[len] != '\0') && (n->v_path[len] != '/'))))
+				continue;
+			if(atomic_cmpxchg(&n->v_refcnt, 0, -1) != 0)
+				continue;
+			spin_lock(&node_lru_lock);
+			if(!list_empty(&n->v_lru))
+			{
+				list_del_init(&n->v_lru);
+				node_lru_count--;
+			}
+			spin_unlock(&node_lru_lock);
+			list_del(&n->v_link);
+			list_add(&n->v_link, &kill);
+		}
+		rwlock_write_unlock(&node_list_lock[i]);
+	}
+
+	if(list_empty(&kill))
+		return;
+	list_for_each_entry_safe(n, t, &kill, v_link)
+	{
+		list_del(&n->v_link);
+		vfs_node_destroy(n);
+	}
+	goto again;
+}
+
+static void vfs_node_invalidate(const char * path)
+{
+	struct vfs_mount_t * m;
+	char node[VFS_MAX_PATH];
+	char * p;
+	int i = 0;
+
+	if(vfs_findroot(path, &m, &p))
+		return;
+
+	while(*p != '\0')
+	{
+		while(*p == '/')
+			p++;
+		if(*p == '\0')
+			break;
+		if(i >= VFS_MAX_PATH - 2)
+			return;
+		node[i++] = '/';
+		while(*p != '\0' && *p != '/' && i < VFS_MAX_PATH - 1)
+			node[i++] = *p++;
+	}
+	node[i] = '\0';
+
+	vfs_node_purge(m, (i > 0) ? node : NULL);
+}
+
+static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, struct vfs_node_t * parent, const char * path, u32_t hash)
 {
 	struct vfs_node_t * n;
-	u32_t hash = vfs_node_hash(m, path);
 	int err;
 
-	if(!(n = calloc(1, sizeof(struct vfs_node_t))))
+	if(!(n = kmem_cache_alloc(__vfs_node_cache)))
 		return NULL;
+	memset(n, 0, sizeof(struct vfs_node_t));
 
 	init_list_head(&n->v_link);
+	init_list_head(&n->v_lru);
 	mutex_init(&n->v_lock);
 	n->v_mount = m;
+	n->v_hash = hash;
 	atomic_set(&n->v_refcnt, 1);
 	if(strlcpy(n->v_path, path, sizeof(n->v_path)) >= sizeof(n->v_path))
 	{
-		free(n);
+		kmem_cache_free(__vfs_node_cache, n);
 		return NULL;
 	}
 
@@ -240,65 +471,110 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	mutex_unlock(&m->m_lock);
 	if(err)
 	{
-		free(n);
+		kmem_cache_free(__vfs_node_cache, n);
 		return NULL;
 	}
 
 	atomic_add(&m->m_refcnt, 1);
-	mutex_lock(&node_list_lock[hash]);
+	if(parent)
+	{
+		vfs_node_ref(parent);
+		n->v_parent = parent;
+	}
+	hash &= VFS_NODE_HASH_SIZE - 1;
+	rwlock_write_lock(&node_list_lock[hash]);
 	list_add(&n->v_link, &node_list[hash]);
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_write_unlock(&node_list_lock[hash]);
 
 	return n;
 }
 
-static struct vfs_node_t * vfs_node_lookup(struct vfs_mount_t * m, const char * path)
+static struct vfs_node_t * vfs_node_lookup(struct vfs_mount_t * m, const char * path, u32_t hash)
 {
 	struct vfs_node_t * n;
-	u32_t hash = vfs_node_hash(m, path);
 	int found = 0;
+	int ref;
 
-	mutex_lock(&node_list_lock[hash]);
-	list_for_each_entry(n, &node_list[hash], v_link)
+	rwlock_read_lock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+	list_for_each_entry(n, &node_list[hash & (VFS_NODE_HASH_SIZE - 1)], v_link)
 	{
-		if((n->v_mount == m) && (!strncmp(n->v_path, path, VFS_MAX_PATH)))
+		if((n->v_hash == hash) && (n->v_mount == m) && (!strncmp(n->v_path, path, VFS_MAX_PATH)))
 		{
+			do {
+				ref = atomic_get(&n->v_refcnt);
+			} while((ref >= 0) && (atomic_cmpxchg(&n->v_refcnt, ref, ref + 1) != ref));
+			if(ref < 0)
+				continue;
+			if(ref == 0)
+			{
+				spin_lock(&node_lru_lock);
+				if(!list_empty(&n->v_lru))
+				{
+					list_del_init(&n->v_lru);
+					node_lru_count--;
+				}
+				spin_unlock(&node_lru_lock);
+			}
 			found = 1;
 			break;
 		}
 	}
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_read_unlock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
 
 	if(!found)
 		return NULL;
-	atomic_add(&n->v_refcnt, 1);
 
 	return n;
 }
 
-static void vfs_node_ref(struct vfs_node_t * n)
-{
-	atomic_add(&n->v_refcnt, 1);
-}
-
-static void vfs_node_put(struct vfs_node_t * n)
+/*
+ * Only the last reference is dropped with the node lru lock held, so the
+ * node can not be evicted and freed by another cpu before it is on the lru
+ * list. A node that is not cached is claimed straight from one reference
+ * to the evicted state instead.
+ */
+static void __vfs_node_put(struct vfs_node_t * n)
 {
 	u32_t hash;
+	int ref;
 
-	if(atomic_sub_return(&n->v_refcnt, 1))
-		return;
+	while(1)
+	{
+		ref = atomic_get(&n->v_refcnt);
+		if(ref > 1)
+		{
+			if(atomic_cmpxchg(&n->v_refcnt, ref, ref - 1) == ref)
+				return;
+			continue;
+		}
 
-	hash = vfs_node_hash(n->v_mount, n->v_path);
-	mutex_lock(&node_list_lock[hash]);
-	list_del(&n->v_link);
-	mutex_unlock(&node_list_lock[hash]);
+		if((n->v_flags == VNF_ROOT) || (n->v_flags == VNF_STALE) || (n->v_mount->m_fs->flags & FS_NOCACHE))
+		{
+			if(atomic_cmpxchg(&n->v_refcnt, 1, -1) != 1)
+				continue;
+			hash = n->v_hash & (VFS_NODE_HASH_SIZE - 1);
+			rwlock_write_lock(&node_list_lock[hash]);
+			list_del(&n->v_link);
+			rwlock_write_unlock(&node_list_lock[hash]);
+			vfs_node_destroy(n);
+			return;
+		}
 
-	mutex_lock(&n->v_mount->m_lock);
-	n->v_mount->m_fs->vput(n->v_mount, n);
-	mutex_unlock(&n->v_mount->m_lock);
+		spin_lock(&node_lru_lock);
+		if((atomic_sub_return(&n->v_refcnt, 1) == 0) && list_empty(&n->v_lru))
+		{
+			list_add(&n->v_lru, &node_lru);
+			node_lru_count++;
+		}
+		spin_unlock(&node_lru_lock);
+		return;
+	}
+}
 
-	atomic_sub(&n->v_mount->m_refcnt, 1);
-	free(n);
+static void vfs_node_put(struct vfs_node_t * n)
+{
+	__vfs_node_put(n);
+	vfs_node_evict();
 }
 
 static int vfs_node_stat(struct vfs_node_t * n, struct vfs_stat_t * st)
@@ -410,7 +686,7 @@ static void vfs_node_release(struct vfs_node_t * n)
 		if(path[0] == '\0')
 			break;
 
-		n = vfs_node_lookup(m, path);
+		n = vfs_node_lookup(m, path, vfs_node_hash(m, path));
 		if(!n)
 			continue;
 
@@ -426,6 +702,7 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 	struct vfs_node_t * dn, * n;
 	char node[VFS_MAX_PATH];
 	char * p;
+	u32_t val = 0;
 	int err, i, j;
 
 	if(vfs_findroot(path, &m, &p))
@@ -447,23 +724,25 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 			break;
 
 		node[i] = '/';
+		val = ((val << 5) + val) + '/';
 		i++;
 		j = i;
 		while(*p != '\0' && *p != '/')
 		{
 			node[i] = *p;
+			val = ((val << 5) + val) + *p;
 			p++;
 			i++;
 		}
 		node[i] = '\0';
 
-		n = vfs_node_lookup(m, node);
+		n = vfs_node_lookup(m, node, val ^ (u32_t)((unsigned long)m));
 		if(n == NULL)
 		{
-			n = vfs_node_get(m, node);
+			n = vfs_node_get(m, dn, node, val ^ (u32_t)((unsigned long)m));
 			if(n == NULL)
 			{
-				vfs_node_put(dn);
+				vfs_node_release(dn);
 				return -1;
 			}
 
@@ -472,12 +751,23 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 			err = dn->v_mount->m_fs->lookup(dn, &node[j], n);
 			mutex_unlock(&dn->v_lock);
 			mutex_unlock(&n->v_lock);
-			if(err || (*p == '/' && n->v_type != VNT_DIR))
+			if(err)
 			{
+				n->v_flags = (err == ENOENT) ? VNF_NEGATIVE : VNF_STALE;
 				vfs_node_release(n);
 				return err;
 			}
 		}
+		else if((n->v_flags == VNF_NEGATIVE) || (n->v_flags == VNF_STALE))
+		{
+			vfs_node_release(n);
+			return -1;
+		}
+		if(*p == '/' && n->v_type != VNT_DIR)
+		{
+			vfs_node_release(n);
+			return -1;
+		}
 		dn = n;
 	}
 	*np = n;
@@ -508,6 +798,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 		vfs_force_unmount(tm);
 	}
 	list_del(&m->m_link);
+	mnt_trie_del(m);
 
 	mutex_lock(&fd_file_lock);
 	for(i = 0; i < VFS_MAX_FD; i++)
@@ -525,7 +816,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
-		mutex_lock(&node_list_lock[i]);
+		rwlock_write_lock(&node_list_lock[i]);
 		while(1)
 		{
 			found = 0;
@@ -541,12 +832,19 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 				break;
 
 			list_del(&n->v_link);
+			spin_lock(&node_lru_lock);
+			if(!list_empty(&n->v_lru))
+			{
+				list_del_init(&n->v_lru);
+				node_lru_count--;
+			}
+			spin_unlock(&node_lru_lock);
 			mutex_lock(&n->v_mount->m_lock);
 			n->v_mount->m_fs->vput(n->v_mount, n);
 			mutex_unlock(&n->v_mount->m_lock);
-			free(n);
+			kmem_cache_free(__vfs_node_cache, n);
 		}
-		mutex_unlock(&node_list_lock[i]);
+		rwlock_write_unlock(&node_list_lock[i]);
 	}
 
 	mutex_lock(&m->m_lock);
@@ -617,7 +915,7 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 	}
 	m->m_covered = n_covered;
 
-	if(!(n = vfs_node_get(m, "/")))
+	if(!(n = vfs_node_get(m, NULL, "/", vfs_node_hash(m, "/"))))
 	{
 		if(m->m_covered)
 			vfs_node_release(m->m_covered);
@@ -660,6 +958,18 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 			return -1;
 		}
 	}
+	if(mnt_trie_add(m) != 0)
+	{
+		mutex_unlock(&mnt_list_lock);
+		mutex_lock(&m->m_lock);
+		m->m_fs->unmount(m);
+		mutex_unlock(&m->m_lock);
+		vfs_node_release(m->m_root);
+		if(m->m_covered)
+			vfs_node_release(m->m_covered);
+		free(m);
+		return -1;
+	}
 	list_add(&m->m_link, &mnt_list);
 	mutex_unlock(&mnt_list_lock);
 
@@ -687,12 +997,14 @@ int vfs_unmount(const char * path)
 		mutex_unlock(&mnt_list_lock);
 		return -1;
 	}
+	vfs_node_purge(m, NULL);
 	if(atomic_get(&m->m_refcnt) > 1)
 	{
 		mutex_unlock(&mnt_list_lock);
 		return -1;
 	}
 	list_del(&m->m_link);
+	mnt_trie_del(m);
 	mutex_unlock(&mnt_list_lock);
 
 	mutex_lock(&m->m_lock);
@@ -720,6 +1032,8 @@ int vfs_sync(void)
 		mutex_lock(&m->m_lock);
 		m->m_fs->msync(m);
 		mutex_unlock(&m->m_lock);
+		if(m->m_dev)
+			block_sync(m->m_dev);
 	}
 	mutex_unlock(&mnt_list_lock);
 
@@ -841,6 +1155,7 @@ int vfs_open(const char * path, u32_t flags, u32_t mode)
 			vfs_node_release(dn);
 			if(err)
 				return err;
+			vfs_node_invalidate(path);
 			if((err = vfs_node_acquire(path, &n)))
 				return err;
 			flags &= ~O_TRUNC;
@@ -985,6 +1300,38 @@ u64_t vfs_read(int fd, void * buf, u64_t len)
 	return ret;
 }
 
+/*
+ * Map len bytes at off of a regular file opened for reading, only works on
+ * filesystems whose data already lives in memory. The pointer is read only
+ * and stays valid while the file is open and not modified.
+ */
+void * vfs_mmap(int fd, s64_t off, u64_t len)
+{
+	struct vfs_node_t * n;
+	struct vfs_file_t * f;
+	void * ret = NULL;
+
+	if((off < 0) || !len)
+		return NULL;
+
+	f = vfs_fd_to_file(fd);
+	if(!f)
+		return NULL;
+
+	mutex_lock(&f->f_lock);
+	n = f->f_node;
+	if(n && (n->v_type == VNT_REG) && (f->f_flags & O_RDONLY) && n->v_mount->m_fs->mmap)
+	{
+		mutex_lock(&n->v_lock);
+		if((off < n->v_size) && (len <= (u64_t)(n->v_size - off)))
+			ret = n->v_mount->m_fs->mmap(n, off, len);
+		mutex_unlock(&n->v_lock);
+	}
+	mutex_unlock(&f->f_lock);
+
+	return ret;
+}
+
 u64_t vfs_write(int fd, void * buf, u64_t len)
 {
 	struct vfs_node_t * n;
@@ -1333,6 +1680,7 @@ int vfs_mkdir(const char * path, u32_t mode)
 fail:
 	mutex_unlock(&dn->v_lock);
 	vfs_node_release(dn);
+	vfs_node_invalidate(path);
 
 	return err;
 }
@@ -1376,6 +1724,7 @@ int vfs_rmdir(const char * path)
 	if((err = vfs_check_dir_empty(path)))
 		return err;
 
+	vfs_node_invalidate(path);
 	if((err = vfs_node_acquire(path, &n)))
 		return err;
 
@@ -1414,6 +1763,7 @@ fail:
 	mutex_unlock(&dn->v_lock);
 	vfs_node_release(n);
 	vfs_node_release(dn);
+	vfs_node_invalidate(path);
 
 	return err;
 }
@@ -1434,6 +1784,7 @@ int vfs_rename(const char * src, const char * dst)
 	if((len < strlen(dst)) && !strncmp(src, dst, len) && (dst[len] == '/'))
 		return -1;
 
+	vfs_node_invalidate(src);
 	if((err = vfs_node_acquire(src, &n1)))
 		return err;
 
@@ -1494,6 +1845,11 @@ fail2:
 	vfs_node_release(sn);
 fail1:
 	vfs_node_release(n1);
+	if(!err)
+	{
+		vfs_node_invalidate(src);
+		vfs_node_invalidate(dst);
+	}
 
 	return err;
 }
@@ -1555,6 +1911,7 @@ fail1:
 	mutex_unlock(&n->v_lock);
 	vfs_node_release(dn);
 	vfs_node_release(n);
+	vfs_node_invalidate(path);
 
 	return err;
 }
@@ -1622,8 +1979,16 @@ void do_init_vfs(void)
 {
 	int i;
 
+	__vfs_node_cache = kmem_cache_create("vfs_node", sizeof(struct vfs_node_t), 0);
 	init_list_head(&mnt_list);
 	mutex_init(&mnt_list_lock);
+	init_list_head(&mnt_trie.entry);
+	init_list_head(&mnt_trie.child);
+	mnt_trie.mount = NULL;
+	seqlock_init(&mnt_trie_lock);
+	init_list_head(&node_lru);
+	spin_lock_init(&node_lru_lock);
+	node_lru_count = 0;
 
 	for(i = 0; i < VFS_MAX_FD; i++)
 	{
@@ -1637,6 +2002,6 @@ void do_init_vfs(void)
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
 		init_list_head(&node_list[i]);
-		mutex_init(&node_list_lock[i]);
+		rwlock_init(&node_list_lock[i]);
 	}
 }
@@ -248,6 +248,15 @@ static s64_t dir_length(void * f)
 	return st.st_size;
 }
 
+static void * dir_map(void * f)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	struct vfs_stat_t st;
+	if((vfs_fstat(fh->fd, &st) < 0) || (st.st_size <= 0))
+		return NULL;
+	return vfs_mmap(fh->fd, 0, st.st_size);
+}
+
 static void dir_close(void * f)
 {
 	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
@@ -270,6 +279,7 @@ static struct xfs_archiver_t archiver_dir = {
 	.seek		= dir_seek,
 	.tell		= dir_tell,
 	.length		= dir_length,
+	.map		= dir_map,
 	.close		= dir_close,
 };
 
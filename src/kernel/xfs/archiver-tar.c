@@ -408,6 +408,14 @@ static s64_t tar_length(void * f)
 	return fh->size;
 }
 
+static void * tar_map(void * f)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	if(fh->size <= 0)
+		return NULL;
+	return vfs_mmap(fh->fd, fh->start, fh->size);
+}
+
 static void tar_close(void * f)
 {
 	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
@@ -429,6 +437,7 @@ static struct xfs_archiver_t archiver_tar = {
 	.seek		= tar_seek,
 	.tell		= tar_tell,
 	.length		= tar_length,
+	.map		= tar_map,
 	.close		= tar_close,
 };
 
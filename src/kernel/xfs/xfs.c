@@ -243,6 +243,8 @@ struct xfs_file_t * xfs_open_read(struct xfs_context_t * ctx, const char * name)
 			file->ctx = ctx;
 			file->path = pos;
 			file->fhandle = f;
+			file->map = NULL;
+			file->cache = NULL;
 			break;
 		}
 	}
@@ -271,6 +273,8 @@ struct xfs_file_t * xfs_open_write(struct xfs_context_t * ctx, const char * name
 				file->ctx = ctx;
 				file->path = pos;
 				file->fhandle = f;
+				file->map = NULL;
+				file->cache = NULL;
 				break;
 			}
 		}
@@ -300,6 +304,8 @@ struct xfs_file_t * xfs_open_append(struct xfs_context_t * ctx, const char * nam
 				file->ctx = ctx;
 				file->path = pos;
 				file->fhandle = f;
+				file->map = NULL;
+				file->cache = NULL;
 				break;
 			}
 		}
@@ -343,11 +349,59 @@ s64_t xfs_length(struct xfs_file_t * file)
 	return 0;
 }
 
+/*
+ * Return the whole file contents as a read only buffer, pointing straight at
+ * the backing memory when the archiver can map it, otherwise at a copy read
+ * in once. The buffer stays valid until the file is closed.
+ */
+void * xfs_map(struct xfs_file_t * file)
+{
+	struct xfs_archiver_t * archiver;
+	s64_t len, pos, n, ret = 0;
+	char * buf;
+
+	if(!file)
+		return NULL;
+	if(file->map)
+		return file->map;
+
+	archiver = file->path->archiver;
+	if(archiver->map && (file->map = archiver->map(file->fhandle)))
+		return file->map;
+
+	len = archiver->length(file->fhandle);
+	if(len <= 0)
+		return NULL;
+	buf = malloc(len);
+	if(!buf)
+		return NULL;
+
+	pos = archiver->tell(file->fhandle);
+	archiver->seek(file->fhandle, 0);
+	while(ret < len)
+	{
+		n = archiver->read(file->fhandle, buf + ret, len - ret);
+		if(n <= 0)
+			break;
+		ret += n;
+	}
+	archiver->seek(file->fhandle, pos);
+	if(ret != len)
+	{
+		free(buf);
+		return NULL;
+	}
+	file->cache = file->map = buf;
+	return file->map;
+}
+
 void xfs_close(struct xfs_file_t * file)
 {
 	if(file)
 	{
 		file->path->archiver->close(file->fhandle);
+		if(file->cache)
+			free(file->cache);
 		free(file);
 	}
 }
@@ -4,10 +4,13 @@
 
 #include <xconfigs.h>
 #include <assert.h>
+#include <atomic.h>
 #include <spinlock.h>
+#include <smp.h>
 #include <string.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <xboot/rawlock.h>
 #include <xboot/kobj.h>
 #include <xboot/module.h>
 
@@ -817,51 +820,242 @@ void mm_info(void * mm, size_t * mused, size_t * mfree)
 		tlsf_info(mm, mused, mfree);
 }
 
-static void * __heap_pool = NULL;
-static spinlock_t __heap_lock = SPIN_LOCK_INIT();
+void mm_walk(void * mm, void (*cb)(void * ptr, size_t size, int used, void * data), void * data)
+{
+	block_header_t * block = offset_to_block(mm, -(int)block_header_overhead);
 
-static void * __malloc(size_t size)
+	while(cb && block && !block_is_last(block))
+	{
+		cb(block_to_ptr(block), block_get_size(block), !block_is_free(block), data);
+		block = block_next(block);
+	}
+}
+
+void mm_mapping(size_t size, int * fl, int * sl)
 {
-	void * m;
+	mapping_insert(size, fl, sl);
+}
+
+/*
+ * Per cpu heap arena, every cpu allocates from its own tlsf control block. A block
+ * freed by another cpu is pushed onto the remote free list of its owner without
+ * locking, and the owner returns it to tlsf on the next heap operation. On smp,
+ * half of the heap is kept in a shared arena, which serves large blocks and any
+ * request the local arena can not satisfy, so the largest block is not cut down
+ * to a per cpu share.
+ */
+struct heap_arena_t {
+	void * pool;
+	char * start;
+	char * end;
+	atomic_t rfree;
+	rawlock_t lock;
+};
+
+static struct heap_arena_t __heap_arena[CONFIG_MAX_SMP_CPUS + 1];
+static struct heap_arena_t * __heap_shared = NULL;
+static int __heap_narena = 0;
+
+#define heap_arena_lock(a, flags)		raw_lock_irqsave(&(a)->lock, flags)
+#define heap_arena_unlock(a, flags)		raw_unlock_irqrestore(&(a)->lock, flags)
+
+#if defined(CONFIG_HEAP_PROFILE) && (CONFIG_HEAP_PROFILE > 0)
+/*
+ * With heap profiling, every block carries a trailing tag holding the return
+ * address of its allocator and the requested size.
+ */
+struct heap_tag_t {
+	void * caller;
+	size_t size;
+};
+#define HEAP_TAG_SIZE	(sizeof(struct heap_tag_t))
+
+static inline struct heap_tag_t * heap_tag_of(void * ptr)
+{
+	return (struct heap_tag_t *)((char *)ptr + block_get_size(block_from_ptr(ptr)) - HEAP_TAG_SIZE);
+}
+
+static inline void heap_tag_set(void * ptr, void * caller, size_t size)
+{
+	struct heap_tag_t * t = heap_tag_of(ptr);
+
+	t->caller = caller;
+	t->size = size;
+}
+#else
+#define HEAP_TAG_SIZE	(0)
+
+static inline void heap_tag_set(void * ptr, void * caller, size_t size)
+{
+}
+#endif
+
+static inline struct heap_arena_t * heap_arena_self(void)
+{
+	return &__heap_arena[smp_processor_id() % CONFIG_MAX_SMP_CPUS];
+}
 
-	if(__heap_pool)
+static inline struct heap_arena_t * heap_arena_of(void * ptr)
+{
+	struct heap_arena_t * a;
+	int i;
+
+	for(i = 0; i < __heap_narena; i++)
 	{
-		spin_lock(&__heap_lock);
-		m = tlsf_malloc(__heap_pool, size);
-		spin_unlock(&__heap_lock);
-		return m;
+		a = &__heap_arena[i];
+		if(((char *)ptr >= a->start) && ((char *)ptr < a->end))
+			return a;
 	}
 	return NULL;
 }
-extern __typeof(__malloc) malloc __attribute__((weak, alias("__malloc")));
 
-static void * __memalign(size_t align, size_t size)
+static inline void heap_arena_remote_free(struct heap_arena_t * a, void * ptr)
 {
+	int idx = (int)(((char *)ptr - a->start) / ALIGN_SIZE) + 1;
+	int head;
+
+	do {
+		head = atomic_get(&a->rfree);
+		*((int *)ptr) = head;
+		smp_wmb();
+	} while(atomic_cmpxchg(&a->rfree, head, idx) != head);
+}
+
+static inline void heap_arena_drain(struct heap_arena_t * a)
+{
+	void * p;
+	int idx;
+
+	if(atomic_get(&a->rfree) != 0)
+	{
+		do {
+			idx = atomic_get(&a->rfree);
+		} while(atomic_cmpxchg(&a->rfree, idx, 0) != idx);
+		smp_rmb();
+		while(idx > 0)
+		{
+			p = a->start + (idx - 1) * ALIGN_SIZE;
+			idx = *((int *)p);
+			tlsf_free(a->pool, p);
+		}
+	}
+}
+
+static inline int heap_arena_is_local(struct heap_arena_t * a)
+{
+	return ((a == heap_arena_self()) || (a == __heap_shared)) ? 1 : 0;
+}
+
+static void * heap_arena_alloc(struct heap_arena_t * a, size_t align, size_t size)
+{
+	irq_flags_t flags;
+	void * m;
+
+	heap_arena_lock(a, flags);
+	heap_arena_drain(a);
+	if(align > 0)
+		m = tlsf_memalign(a->pool, align, size);
+	else
+		m = tlsf_malloc(a->pool, size);
+	heap_arena_unlock(a, flags);
+	return m;
+}
+
+static void * heap_alloc(size_t align, size_t size, void * caller)
+{
+	struct heap_arena_t * first, * a;
 	void * m;
+	int i;
 
-	if(__heap_pool)
+	if(__heap_narena <= 0)
+		return NULL;
+	if(__heap_shared && (size >= CONFIG_HEAP_LARGE_SIZE))
+		first = __heap_shared;
+	else
+		first = heap_arena_self();
+	if(!(m = heap_arena_alloc(first, align, size + HEAP_TAG_SIZE)))
 	{
-		spin_lock(&__heap_lock);
-		m = tlsf_memalign(__heap_pool, align, size);
-		spin_unlock(&__heap_lock);
-		return m;
+		for(i = __heap_narena - 1; i >= 0; i--)
+		{
+			a = &__heap_arena[i];
+			if((a != first) && (m = heap_arena_alloc(a, align, size + HEAP_TAG_SIZE)))
+				break;
+		}
 	}
-	return NULL;
+	if(m)
+		heap_tag_set(m, caller, size);
+	return m;
+}
+
+static void * __malloc(size_t size)
+{
+	return heap_alloc(0, size, __builtin_return_address(0));
+}
+extern __typeof(__malloc) malloc __attribute__((weak, alias("__malloc")));
+
+static void * __memalign(size_t align, size_t size)
+{
+	return heap_alloc(align, size, __builtin_return_address(0));
 }
 extern __typeof(__memalign) memalign __attribute__((weak, alias("__memalign")));
 
+static void __free(void * ptr)
+{
+	struct heap_arena_t * a;
+	irq_flags_t flags;
+
+	if(ptr && (a = heap_arena_of(ptr)))
+	{
+		if(heap_arena_is_local(a))
+		{
+			heap_arena_lock(a, flags);
+			heap_arena_drain(a);
+			tlsf_free(a->pool, ptr);
+			heap_arena_unlock(a, flags);
+		}
+		else
+		{
+			heap_arena_remote_free(a, ptr);
+		}
+	}
+}
+extern __typeof(__free) free __attribute__((weak, alias("__free")));
+
 static void * __realloc(void * ptr, size_t size)
 {
+	struct heap_arena_t * a;
+	irq_flags_t flags;
 	void * m;
+	size_t cursize;
 
-	if(__heap_pool)
+	if(!ptr)
+		return heap_alloc(0, size, __builtin_return_address(0));
+	if(size == 0)
 	{
-		spin_lock(&__heap_lock);
-		m = tlsf_realloc(__heap_pool, ptr, size);
-		spin_unlock(&__heap_lock);
-		return m;
+		__free(ptr);
+		return NULL;
 	}
-	return NULL;
+	if(!(a = heap_arena_of(ptr)))
+		return NULL;
+	if(heap_arena_is_local(a))
+	{
+		heap_arena_lock(a, flags);
+		heap_arena_drain(a);
+		m = tlsf_realloc(a->pool, ptr, size + HEAP_TAG_SIZE);
+		heap_arena_unlock(a, flags);
+		if(m)
+		{
+			heap_tag_set(m, __builtin_return_address(0), size);
+			return m;
+		}
+	}
+	cursize = block_get_size(block_from_ptr(ptr));
+	if((m = heap_alloc(0, size, __builtin_return_address(0))))
+	{
+		memcpy(m, ptr, tlsf_min(cursize, size));
+		__free(ptr);
+	}
+	return m;
 }
 extern __typeof(__realloc) realloc __attribute__((weak, alias("__realloc")));
 
@@ -869,32 +1063,88 @@ static void * __calloc(size_t nmemb, size_t size)
 {
 	void * m;
 
-	if((m = malloc(nmemb * size)))
+	if((m = heap_alloc(0, nmemb * size, __builtin_return_address(0))))
 		memset(m, 0, nmemb * size);
 	return m;
 }
 extern __typeof(__calloc) calloc __attribute__((weak, alias("__calloc")));
 
-static void __free(void * ptr)
+static void __meminfo(size_t * mused, size_t * mfree)
+{
+	struct heap_arena_t * a;
+	irq_flags_t flags;
+	size_t u, f;
+	int i;
+
+	if(mused && mfree)
+	{
+		*mused = 0;
+		*mfree = 0;
+		for(i = 0; i < __heap_narena; i++)
+		{
+			a = &__heap_arena[i];
+			heap_arena_lock(a, flags);
+			heap_arena_drain(a);
+			tlsf_info(mm_get(a->pool), &u, &f);
+			heap_arena_unlock(a, flags);
+			*mused += u;
+			*mfree += f;
+		}
+	}
+}
+extern __typeof(__meminfo) meminfo __attribute__((weak, alias("__meminfo")));
+
+struct heap_walk_data_t {
+	void (*cb)(void * ptr, size_t size, int used, void * caller, void * data);
+	void * data;
+};
+
+static void heap_walk_block(void * ptr, size_t size, int used, void * data)
 {
-	if(__heap_pool)
+	struct heap_walk_data_t * wd = (struct heap_walk_data_t *)data;
+	void * caller = NULL;
+
+#if defined(CONFIG_HEAP_PROFILE) && (CONFIG_HEAP_PROFILE > 0)
+	struct heap_tag_t * t;
+
+	if(used && (size >= HEAP_TAG_SIZE))
 	{
-		spin_lock(&__heap_lock);
-		tlsf_free(__heap_pool, ptr);
-		spin_unlock(&__heap_lock);
+		t = heap_tag_of(ptr);
+		if(t->size <= size - HEAP_TAG_SIZE)
+		{
+			caller = t->caller;
+			size = t->size;
+		}
 	}
+#endif
+	wd->cb(ptr, size, used, caller, wd->data);
 }
-extern __typeof(__free) free __attribute__((weak, alias("__free")));
 
-static void __meminfo(size_t * mused, size_t * mfree)
+/*
+ * Walk every block of the system heap. The arena lock is held while the
+ * callback runs, so it must not allocate or free memory.
+ */
+void heap_walk(void (*cb)(void * ptr, size_t size, int used, void * caller, void * data), void * data)
 {
-	if(__heap_pool)
+	struct heap_walk_data_t wd;
+	struct heap_arena_t * a;
+	irq_flags_t flags;
+	int i;
+
+	if(cb)
 	{
-		if(mused && mfree)
-			tlsf_info(mm_get(__heap_pool), mused, mfree);
+		wd.cb = cb;
+		wd.data = data;
+		for(i = 0; i < __heap_narena; i++)
+		{
+			a = &__heap_arena[i];
+			heap_arena_lock(a, flags);
+			heap_arena_drain(a);
+			mm_walk(mm_get(a->pool), heap_walk_block, &wd);
+			heap_arena_unlock(a, flags);
+		}
 	}
 }
-extern __typeof(__meminfo) meminfo __attribute__((weak, alias("__meminfo")));
 
 static struct kobj_t * search_class_memory_kobj(void)
 {
@@ -915,13 +1165,38 @@ static ssize_t memory_read_meminfo(struct kobj_t * kobj, void * buf, size_t size
 	return len;
 }
 
+#ifndef __SANDBOX__
+static void heap_arena_init(struct heap_arena_t * a, char * start, char * end)
+{
+	a->start = align_ptr(start, ALIGN_SIZE);
+	a->end = end;
+	a->pool = mm_create(a->start, align_down(a->end - a->start, ALIGN_SIZE));
+	atomic_set(&a->rfree, 0);
+	rawlock_init(&a->lock);
+}
+#endif
+
 void do_init_mem(void)
 {
 #ifndef __SANDBOX__
 	extern unsigned char __heap_start[];
 	extern unsigned char __heap_end[];
-	spin_lock_init(&__heap_lock);
-	__heap_pool = mm_create((void *)__heap_start, (size_t)(__heap_end - __heap_start));
+	char * start = (char *)__heap_start;
+	char * end = (char *)__heap_end;
+	size_t size;
+	int i;
+
+	if(CONFIG_MAX_SMP_CPUS > 1)
+	{
+		size = (size_t)(end - start) / 2;
+		heap_arena_init(&__heap_arena[CONFIG_MAX_SMP_CPUS], start + size, end);
+		__heap_shared = &__heap_arena[CONFIG_MAX_SMP_CPUS];
+		end = start + size;
+	}
+	size = (size_t)(end - start) / CONFIG_MAX_SMP_CPUS;
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		heap_arena_init(&__heap_arena[i], start + size * i, start + size * (i + 1));
+	__heap_narena = __heap_shared ? CONFIG_MAX_SMP_CPUS + 1 : CONFIG_MAX_SMP_CPUS;
 #endif
 	kobj_add_regular(search_class_memory_kobj(), "meminfo", memory_read_meminfo, NULL, NULL);
 }
@@ -0,0 +1,376 @@
+/*
+ * lib/libc/malloc/slab.c
+ */
+
+#include <xconfigs.h>
+#include <types.h>
+#include <sizes.h>
+#include <string.h>
+#include <stdio.h>
+#include <smp.h>
+#include <irqflags.h>
+#include <spinlock.h>
+#include <log2.h>
+#include <malloc.h>
+#include <slab.h>
+#include <xboot/kobj.h>
+#include <xboot/initcall.h>
+
+/*
+ * Every slab is a naturally aligned block holding a header and a run of
+ * objects of the same size, so the owning slab of an object is found by
+ * masking its address. Each cpu keeps a small magazine of free objects in
+ * front of the slab lists, the cache lock is only taken to refill or flush
+ * half a magazine at a time.
+ */
+struct kmem_slab_t {
+	struct list_head entry;
+	struct kmem_cache_t * cache;
+	void * free;
+	int inuse;
+};
+
+static LIST_HEAD(__kmem_cache_list);
+static spinlock_t __kmem_cache_lock = SPIN_LOCK_INIT();
+static int __kmem_kobj_ready = 0;
+
+static const size_t __kmem_sizes[] = { 16, 32, 64, 128, 256 };
+static struct kmem_cache_t * __kmem_caches[ARRAY_SIZE(__kmem_sizes)] = { 0 };
+
+static struct kobj_t * search_class_memory_slab_kobj(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	struct kobj_t * kmemory = kobj_search_directory_with_create(kclass, "memory");
+	return kobj_search_directory_with_create(kmemory, "slab");
+}
+
+static ssize_t kmem_cache_read_stat(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct kmem_cache_t * cache = (struct kmem_cache_t *)kobj->priv;
+	unsigned long hit = 0, miss = 0;
+	int cached = 0;
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		hit += cache->mag[i].hit;
+		miss += cache->mag[i].miss;
+		cached += cache->mag[i].count;
+	}
+	len += sprintf((char *)(p + len), " object size: %ld\r\n", (long)cache->size);
+	len += sprintf((char *)(p + len), " slab size: %ld\r\n", (long)cache->slabsz);
+	len += sprintf((char *)(p + len), " slabs: %d\r\n", cache->nslab);
+	len += sprintf((char *)(p + len), " objects: %d\r\n", cache->nslab * cache->nobjs);
+	len += sprintf((char *)(p + len), " inuse: %d\r\n", cache->inuse - cached);
+	len += sprintf((char *)(p + len), " cached: %d\r\n", cached);
+	len += sprintf((char *)(p + len), " hit: %lu\r\n", hit);
+	len += sprintf((char *)(p + len), " miss: %lu\r\n", miss);
+	return len;
+}
+
+static void kmem_cache_add_kobj(struct kmem_cache_t * cache)
+{
+	cache->kobj = kobj_alloc_regular(cache->name, kmem_cache_read_stat, NULL, cache);
+	if(cache->kobj && !kobj_add(search_class_memory_slab_kobj(), cache->kobj))
+	{
+		kobj_free(cache->kobj);
+		cache->kobj = NULL;
+	}
+}
+
+static inline struct kmem_slab_t * kmem_slab_of(struct kmem_cache_t * cache, void * obj)
+{
+	return (struct kmem_slab_t *)((unsigned long)obj & ~(unsigned long)(cache->slabsz - 1));
+}
+
+static struct kmem_slab_t * kmem_slab_grow(struct kmem_cache_t * cache)
+{
+	struct kmem_slab_t * slab;
+	char * obj;
+	int i;
+
+	slab = memalign(cache->slabsz, cache->slabsz);
+	if(!slab)
+		return NULL;
+	slab->cache = cache;
+	slab->free = NULL;
+	slab->inuse = 0;
+	obj = (char *)slab + cache->offset + cache->size * (cache->nobjs - 1);
+	for(i = 0; i < cache->nobjs; i++, obj -= cache->size)
+	{
+		*((void **)obj) = slab->free;
+		slab->free = obj;
+	}
+	list_add(&slab->entry, &cache->partial);
+	cache->nslab++;
+	return slab;
+}
+
+static void * __kmem_cache_get(struct kmem_cache_t * cache)
+{
+	struct kmem_slab_t * slab;
+	void * obj;
+
+	if(list_empty(&cache->partial))
+	{
+		if(!list_empty(&cache->empty))
+		{
+			list_move(cache->empty.next, &cache->partial);
+			cache->nempty--;
+		}
+		else if(!kmem_slab_grow(cache))
+		{
+			return NULL;
+		}
+	}
+	slab = list_first_entry(&cache->partial, struct kmem_slab_t, entry);
+	obj = slab->free;
+	slab->free = *((void **)obj);
+	slab->inuse++;
+	if(!slab->free)
+		list_move(&slab->entry, &cache->full);
+	cache->inuse++;
+	return obj;
+}
+
+static void __kmem_cache_put(struct kmem_cache_t * cache, void * obj)
+{
+	struct kmem_slab_t * slab = kmem_slab_of(cache, obj);
+
+	if(!slab->free)
+		list_move(&slab->entry, &cache->partial);
+	*((void **)obj) = slab->free;
+	slab->free = obj;
+	slab->inuse--;
+	cache->inuse--;
+	if(slab->inuse == 0)
+	{
+		if(cache->nempty > 0)
+		{
+			list_del(&slab->entry);
+			cache->nslab--;
+			free(slab);
+		}
+		else
+		{
+			list_move(&slab->entry, &cache->empty);
+			cache->nempty++;
+		}
+	}
+}
+
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align)
+{
+	struct kmem_cache_t * cache;
+	irq_flags_t flags;
+	size_t slabsz;
+
+	if(!name || (size == 0))
+		return NULL;
+
+	if(align < sizeof(void *))
+		align = sizeof(void *);
+	if(!is_power_of_2(align))
+		return NULL;
+
+	cache = malloc(sizeof(struct kmem_cache_t));
+	if(!cache)
+		return NULL;
+
+	memset(cache, 0, sizeof(struct kmem_cache_t));
+	cache->name = strdup(name);
+	cache->size = (size + align - 1) & ~(align - 1);
+	cache->offset = (sizeof(struct kmem_slab_t) + align - 1) & ~(align - 1);
+	slabsz = roundup_pow_of_two(cache->offset + cache->size * 8);
+	cache->slabsz = (slabsz < 4096) ? 4096 : slabsz;
+	cache->nobjs = (cache->slabsz - cache->offset) / cache->size;
+	init_list_head(&cache->partial);
+	init_list_head(&cache->full);
+	init_list_head(&cache->empty);
+	spin_lock_init(&cache->lock);
+
+	spin_lock_irqsave(&__kmem_cache_lock, flags);
+	list_add_tail(&cache->entry, &__kmem_cache_list);
+	spin_unlock_irqrestore(&__kmem_cache_lock, flags);
+	if(__kmem_kobj_ready)
+		kmem_cache_add_kobj(cache);
+	return cache;
+}
+
+void kmem_cache_destroy(struct kmem_cache_t * cache)
+{
+	struct kmem_slab_t * pos, * n;
+	irq_flags_t flags;
+
+	if(cache)
+	{
+		spin_lock_irqsave(&__kmem_cache_lock, flags);
+		list_del(&cache->entry);
+		spin_unlock_irqrestore(&__kmem_cache_lock, flags);
+		if(cache->kobj)
+		{
+			kobj_remove(search_class_memory_slab_kobj(), cache->kobj);
+			kobj_free(cache->kobj);
+		}
+		list_for_each_entry_safe(pos, n, &cache->partial, entry)
+			free(pos);
+		list_for_each_entry_safe(pos, n, &cache->full, entry)
+			free(pos);
+		list_for_each_entry_safe(pos, n, &cache->empty, entry)
+			free(pos);
+		free(cache->name);
+		free(cache);
+	}
+}
+
+void * kmem_cache_alloc(struct kmem_cache_t * cache)
+{
+	struct kmem_magazine_t * mag;
+	irq_flags_t flags;
+	void * obj = NULL;
+
+	if(cache)
+	{
+		local_irq_save(flags);
+		mag = &cache->mag[smp_processor_id()];
+		if(mag->count > 0)
+		{
+			obj = mag->objs[--mag->count];
+			mag->hit++;
+		}
+		else
+		{
+			mag->miss++;
+			spin_lock(&cache->lock);
+			while(mag->count < (CONFIG_SLAB_MAGAZINE_SIZE >> 1))
+			{
+				if(!(obj = __kmem_cache_get(cache)))
+					break;
+				mag->objs[mag->count++] = obj;
+			}
+			spin_unlock(&cache->lock);
+			obj = (mag->count > 0) ? mag->objs[--mag->count] : NULL;
+		}
+		local_irq_restore(flags);
+	}
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache_t * cache, void * obj)
+{
+	struct kmem_magazine_t * mag;
+	irq_flags_t flags;
+
+	if(cache && obj)
+	{
+		local_irq_save(flags);
+		mag = &cache->mag[smp_processor_id()];
+		if(mag->count >= CONFIG_SLAB_MAGAZINE_SIZE)
+		{
+			spin_lock(&cache->lock);
+			while(mag->count > (CONFIG_SLAB_MAGAZINE_SIZE >> 1))
+				__kmem_cache_put(cache, mag->objs[--mag->count]);
+			spin_unlock(&cache->lock);
+		}
+		mag->objs[mag->count++] = obj;
+		local_irq_restore(flags);
+	}
+}
+
+static inline int kmem_size_index(size_t size)
+{
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(__kmem_sizes); i++)
+	{
+		if(size <= __kmem_sizes[i])
+			return i;
+	}
+	return -1;
+}
+
+static struct kmem_cache_t * kmem_size_cache(int idx)
+{
+	struct kmem_cache_t * cache;
+	irq_flags_t flags;
+	char name[32];
+
+	if(!__kmem_caches[idx])
+	{
+		sprintf(name, "kmem-%ld", (long)__kmem_sizes[idx]);
+		cache = kmem_cache_create(name, __kmem_sizes[idx], 0);
+		spin_lock_irqsave(&__kmem_cache_lock, flags);
+		if(!__kmem_caches[idx])
+		{
+			__kmem_caches[idx] = cache;
+			cache = NULL;
+		}
+		spin_unlock_irqrestore(&__kmem_cache_lock, flags);
+		if(cache)
+			kmem_cache_destroy(cache);
+	}
+	return __kmem_caches[idx];
+}
+
+void * kmem_alloc(size_t size)
+{
+	int idx = kmem_size_index(size);
+
+	if((size > 0) && (idx >= 0))
+		return kmem_cache_alloc(kmem_size_cache(idx));
+	return malloc(size);
+}
+
+void * kmem_realloc(void * ptr, size_t osize, size_t nsize)
+{
+	int oidx, nidx;
+	void * m;
+
+	if(nsize == 0)
+	{
+		kmem_free(ptr, osize);
+		return NULL;
+	}
+	if(!ptr)
+		return kmem_alloc(nsize);
+	oidx = kmem_size_index(osize);
+	nidx = kmem_size_index(nsize);
+	if((oidx < 0) && (nidx < 0))
+		return realloc(ptr, nsize);
+	if(oidx == nidx)
+		return ptr;
+	if((m = kmem_alloc(nsize)))
+	{
+		memcpy(m, ptr, (osize < nsize) ? osize : nsize);
+		kmem_free(ptr, osize);
+	}
+	return m;
+}
+
+void kmem_free(void * ptr, size_t size)
+{
+	int idx = kmem_size_index(size);
+
+	if(ptr)
+	{
+		if((size > 0) && (idx >= 0))
+			kmem_cache_free(kmem_size_cache(idx), ptr);
+		else
+			free(ptr);
+	}
+}
+
+static __init void slab_pure_init(void)
+{
+	struct kmem_cache_t * pos;
+
+	__kmem_kobj_ready = 1;
+	list_for_each_entry(pos, &__kmem_cache_list, entry)
+	{
+		if(!pos->kobj)
+			kmem_cache_add_kobj(pos);
+	}
+}
+pure_initcall(slab_pure_init);
@@ -11,8 +11,11 @@
 #include <list.h>
 #include <lsort.h>
 #include <malloc.h>
+#include <slab.h>
 #include <hmap.h>
 
+static struct kmem_cache_t * __hmap_entry_cache = NULL;
+
 struct hmap_t * hmap_alloc(unsigned int size)
 {
 	struct hmap_t * m;
@@ -23,6 +26,9 @@ struct hmap_t * hmap_alloc(unsigned int size)
 	if(size & (size - 1))
 		size = roundup_pow_of_two(size);
 
+	if(!__hmap_entry_cache)
+		__hmap_entry_cache = kmem_cache_create("hmap_entry", sizeof(struct hmap_entry_t), 0);
+
 	m = malloc(sizeof(struct hmap_t));
 	if(!m)
 		return NULL;
@@ -70,7 +76,7 @@ void hmap_clear(struct hmap_t * m, void (*cb)(struct hmap_entry_t *))
 			if(cb)
 				cb(pos);
 			free(pos->key);
-			free(pos);
+			kmem_cache_free(__hmap_entry_cache, pos);
 		}
 	}
 }
@@ -136,7 +142,7 @@ void hmap_add(struct hmap_t * m, const char * key, void * value)
 	if(m->n > (m->size >> 1))
 		hmap_resize(m, m->size << 1);
 
-	pos = malloc(sizeof(struct hmap_entry_t));
+	pos = kmem_cache_alloc(__hmap_entry_cache);
 	if(!pos)
 		return;
 
@@ -173,7 +179,7 @@ void hmap_remove(struct hmap_t * m, const char * key)
 			m->n--;
 			spin_unlock_irqrestore(&m->lock, flags);
 			free(pos->key);
-			free(pos);
+			kmem_cache_free(__hmap_entry_cache, pos);
 			return;
 		}
 	}
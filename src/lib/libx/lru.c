@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <malloc.h>
+#include <slab.h>
 #include <lru.h>
 
 static uint32_t lru_hash(const char * key, const int nkey)
@@ -90,7 +91,7 @@ static inline void lru_remove_item_hv(struct lru_t * l, struct lru_item_t * item
 	if(item->prev)
 		item->prev->next = item->next;
 	l->curr_bytes -= item->nbytes;
-	free(item);
+	kmem_free(item, item->nbytes);
 }
 
 static inline void lru_remove_item(struct lru_t * l, struct lru_item_t * item)
@@ -106,7 +107,7 @@ static inline void * lru_alloc_item(struct lru_t * l, int sz, struct lru_item_t
 
 	if((l->curr_bytes + sz - delta) <= l->max_bytes)
 	{
-		m = malloc(sz);
+		m = kmem_alloc(sz);
 		if(!m)
 			return NULL;
 	}
@@ -129,7 +130,7 @@ static inline void * lru_alloc_item(struct lru_t * l, int sz, struct lru_item_t
 				item = l->tail->prev;
 			}
 		}
-		m = malloc(sz);
+		m = kmem_alloc(sz);
 		if(!m)
 			return NULL;
 	}
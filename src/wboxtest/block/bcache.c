@@ -0,0 +1,141 @@
+/*
+ * wboxtest/block/bcache.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_bcache_pdata_t
+{
+	struct block_t * blk;
+	unsigned char * rambuf;
+	size_t size;
+};
+
+static void * bcache_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_bcache_pdata_t * pdat;
+	char json[256];
+	int length;
+
+	pdat = malloc(sizeof(struct wbt_bcache_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->size = CONFIG_BLOCK_CACHE_SIZE;
+	pdat->rambuf = malloc(pdat->size);
+	if(!pdat->rambuf)
+	{
+		free(pdat);
+		return NULL;
+	}
+
+	length = sprintf(json,
+		"{\"blk-ramdisk@998\":{\"address\":%lld,\"size\":%lld}}",
+		(unsigned long long)((virtual_addr_t)pdat->rambuf),
+		(unsigned long long)((virtual_size_t)pdat->size));
+	probe_device(json, length, NULL);
+
+	pdat->blk = search_block("blk-ramdisk.998");
+	if(!pdat->blk)
+	{
+		free(pdat->rambuf);
+		free(pdat);
+		return NULL;
+	}
+
+	return pdat;
+}
+
+static void bcache_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_bcache_pdata_t * pdat = (struct wbt_bcache_pdata_t *)data;
+
+	if(pdat)
+	{
+		unregister_block(pdat->blk);
+		free(pdat->rambuf);
+		free(pdat);
+	}
+}
+
+static void bcache_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_bcache_pdata_t * pdat = (struct wbt_bcache_pdata_t *)data;
+	u64_t blksz, lblkno, lblkcnt, sblkno, sblkcnt;
+	char * large, * small, * buf;
+	int llen, slen;
+
+	if(pdat)
+	{
+		/*
+		 * A large request is bigger than a quarter of the cache and goes
+		 * straight to the device, a small one stays dirty in the cache
+		 * until block_sync.
+		 */
+		blksz = block_size(pdat->blk);
+		lblkcnt = (CONFIG_BLOCK_CACHE_SIZE >> 2) / blksz + wboxtest_random_int(1, 16);
+		lblkno = wboxtest_random_int(0, block_count(pdat->blk) - lblkcnt);
+		sblkcnt = wboxtest_random_int(1, 16);
+		sblkno = lblkno + wboxtest_random_int(0, lblkcnt - sblkcnt);
+		llen = blksz * lblkcnt;
+		slen = blksz * sblkcnt;
+
+		large = malloc(llen);
+		small = malloc(slen);
+		buf = malloc(llen);
+		if(!large || !small || !buf)
+		{
+			free(large);
+			free(small);
+			free(buf);
+			return;
+		}
+
+		wboxtest_random_buffer(large, llen);
+		assert_equal(block_write(pdat->blk, (u8_t *)large, blksz * lblkno, llen), llen);
+		assert_memory_equal(pdat->rambuf + blksz * lblkno, large, llen);
+		assert_equal(block_read(pdat->blk, (u8_t *)buf, blksz * lblkno, llen), llen);
+		assert_memory_equal(buf, large, llen);
+
+		wboxtest_random_buffer(small, slen);
+		assert_equal(block_write(pdat->blk, (u8_t *)small, blksz * sblkno, slen), slen);
+		assert_equal(block_read(pdat->blk, (u8_t *)buf, blksz * sblkno, slen), slen);
+		assert_memory_equal(buf, small, slen);
+
+		memcpy(large + blksz * (sblkno - lblkno), small, slen);
+		assert_equal(block_read(pdat->blk, (u8_t *)buf, blksz * lblkno, llen), llen);
+		assert_memory_equal(buf, large, llen);
+
+		block_sync(pdat->blk);
+		assert_memory_equal(pdat->rambuf + blksz * sblkno, small, slen);
+		assert_equal(block_read(pdat->blk, (u8_t *)buf, blksz * sblkno, slen), slen);
+		assert_memory_equal(buf, small, slen);
+		assert_equal(block_read(pdat->blk, (u8_t *)buf, blksz * lblkno, llen), llen);
+		assert_memory_equal(buf, large, llen);
+
+		free(large);
+		free(small);
+		free(buf);
+	}
+}
+
+static struct wboxtest_t wbt_bcache = {
+	.group	= "block",
+	.name	= "bcache",
+	.setup	= bcache_setup,
+	.clean	= bcache_clean,
+	.run	= bcache_run,
+};
+
+static __init void bcache_wbt_init(void)
+{
+	register_wboxtest(&wbt_bcache);
+}
+
+static __exit void bcache_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_bcache);
+}
+
+wboxtest_initcall(bcache_wbt_init);
+wboxtest_exitcall(bcache_wbt_exit);
@@ -0,0 +1,145 @@
+/*
+ * wboxtest/channel/mpsc.c
+ */
+
+#include <wboxtest.h>
+
+#define MPSC_PRODUCERS		(4)
+#define MPSC_COUNT			(1024)
+
+struct wbt_mpsc_pdata_t;
+
+struct wbt_mpsc_producer_t
+{
+	struct wbt_mpsc_pdata_t * pdat;
+	int id;
+};
+
+struct wbt_mpsc_pdata_t
+{
+	struct channel_t * c;
+	struct semaphore_t done;
+	struct wbt_mpsc_producer_t producer[MPSC_PRODUCERS];
+};
+
+/*
+ * Each byte carries the producer id in the top two bits and a sequence
+ * number in the others. A send may be split, but the pieces of one
+ * producer must still arrive in order.
+ */
+static void mpsc_producer(struct task_t * task, void * data)
+{
+	struct wbt_mpsc_producer_t * p = (struct wbt_mpsc_producer_t *)data;
+	unsigned char buf[37];
+	int seq, n, i;
+
+	for(seq = 0; seq < MPSC_COUNT; seq += n)
+	{
+		n = min(wboxtest_random_int(1, sizeof(buf)), MPSC_COUNT - seq);
+		for(i = 0; i < n; i++)
+			buf[i] = (p->id << 6) | ((seq + i) & 0x3f);
+		channel_send(p->pdat->c, buf, n);
+	}
+	semaphore_up(&p->pdat->done);
+}
+
+static void * mpsc_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_mpsc_pdata_t * pdat;
+	int i;
+
+	pdat = malloc(sizeof(struct wbt_mpsc_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->c = channel_alloc_mode(32, CHANNEL_MODE_MPSC);
+	if(!pdat->c)
+	{
+		free(pdat);
+		return NULL;
+	}
+	semaphore_init(&pdat->done, 0);
+	for(i = 0; i < MPSC_PRODUCERS; i++)
+	{
+		pdat->producer[i].pdat = pdat;
+		pdat->producer[i].id = i;
+	}
+
+	return pdat;
+}
+
+static void mpsc_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_mpsc_pdata_t * pdat = (struct wbt_mpsc_pdata_t *)data;
+
+	if(pdat)
+	{
+		channel_free(pdat->c);
+		free(pdat);
+	}
+}
+
+static void mpsc_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_mpsc_pdata_t * pdat = (struct wbt_mpsc_pdata_t *)data;
+	struct task_t * task;
+	unsigned char buf[29];
+	int next[MPSC_PRODUCERS];
+	int nproducer = 0, errors = 0;
+	int l, n, i, id;
+
+	if(pdat)
+	{
+		for(i = 0; i < MPSC_PRODUCERS; i++)
+		{
+			next[i] = 0;
+			task = task_create(NULL, "wbt-mpsc", mpsc_producer, &pdat->producer[i], 0, 0);
+			if(task)
+			{
+				task_resume(task);
+				nproducer++;
+			}
+		}
+		assert_equal(nproducer, MPSC_PRODUCERS);
+
+		for(l = 0; l < MPSC_COUNT * nproducer; l += n)
+		{
+			n = min(wboxtest_random_int(1, sizeof(buf)), MPSC_COUNT * nproducer - l);
+			channel_recv(pdat->c, buf, n);
+			for(i = 0; i < n; i++)
+			{
+				id = buf[i] >> 6;
+				if((buf[i] & 0x3f) != (next[id] & 0x3f))
+					errors++;
+				next[id]++;
+			}
+		}
+		for(i = 0; i < nproducer; i++)
+			semaphore_down(&pdat->done);
+
+		assert_equal(errors, 0);
+		for(i = 0; i < nproducer; i++)
+			assert_equal(next[i], MPSC_COUNT);
+	}
+}
+
+static struct wboxtest_t wbt_mpsc = {
+	.group	= "channel",
+	.name	= "mpsc",
+	.setup	= mpsc_setup,
+	.clean	= mpsc_clean,
+	.run	= mpsc_run,
+};
+
+static __init void mpsc_wbt_init(void)
+{
+	register_wboxtest(&wbt_mpsc);
+}
+
+static __exit void mpsc_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_mpsc);
+}
+
+wboxtest_initcall(mpsc_wbt_init);
+wboxtest_exitcall(mpsc_wbt_exit);
@@ -0,0 +1,125 @@
+/*
+ * wboxtest/channel/reserve.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_reserve_pdata_t
+{
+	struct channel_t * c;
+	struct semaphore_t done;
+	unsigned char * src;
+	unsigned char * dst;
+	int len;
+};
+
+static void reserve_producer(struct task_t * task, void * data)
+{
+	struct wbt_reserve_pdata_t * pdat = (struct wbt_reserve_pdata_t *)data;
+	unsigned char * p;
+	int l, n;
+
+	for(l = 0; l < pdat->len; l += n)
+	{
+		n = channel_reserve(pdat->c, min(wboxtest_random_int(1, 50), pdat->len - l), &p);
+		memcpy(p, pdat->src + l, n);
+		channel_commit(pdat->c, p, n);
+	}
+	semaphore_up(&pdat->done);
+}
+
+static void * reserve_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_reserve_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_reserve_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->len = SZ_4K;
+	pdat->src = malloc(pdat->len);
+	pdat->dst = malloc(pdat->len);
+	pdat->c = channel_alloc_mode(64, CHANNEL_MODE_SPSC);
+	if(!pdat->src || !pdat->dst || !pdat->c)
+	{
+		channel_free(pdat->c);
+		free(pdat->src);
+		free(pdat->dst);
+		free(pdat);
+		return NULL;
+	}
+	semaphore_init(&pdat->done, 0);
+	wboxtest_random_buffer((char *)pdat->src, pdat->len);
+	memset(pdat->dst, 0, pdat->len);
+
+	return pdat;
+}
+
+static void reserve_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_reserve_pdata_t * pdat = (struct wbt_reserve_pdata_t *)data;
+
+	if(pdat)
+	{
+		channel_free(pdat->c);
+		free(pdat->src);
+		free(pdat->dst);
+		free(pdat);
+	}
+}
+
+static void reserve_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_reserve_pdata_t * pdat = (struct wbt_reserve_pdata_t *)data;
+	struct task_t * task;
+	unsigned char * p;
+	int l, n, outside = 0;
+
+	if(pdat)
+	{
+		/*
+		 * Spans are reserved and peeked in place, clipped at the end of
+		 * the ring, and consumed in part, so every span must stay inside
+		 * the buffer and the data must survive the wraps.
+		 */
+		task = task_create(NULL, "wbt-reserve", reserve_producer, pdat, 0, 0);
+		assert_not_null(task);
+		if(!task)
+			return;
+		task_resume(task);
+		for(l = 0; l < pdat->len; l += n)
+		{
+			n = channel_peek(pdat->c, &p);
+			if((p < pdat->c->buffer) || (p + n > pdat->c->buffer + pdat->c->size))
+				outside++;
+			n = min(n, wboxtest_random_int(1, 50));
+			n = min(n, pdat->len - l);
+			memcpy(pdat->dst + l, p, n);
+			channel_consume(pdat->c, n);
+		}
+		semaphore_down(&pdat->done);
+		assert_equal(outside, 0);
+		assert_memory_equal(pdat->dst, pdat->src, pdat->len);
+	}
+}
+
+static struct wboxtest_t wbt_reserve = {
+	.group	= "channel",
+	.name	= "reserve",
+	.setup	= reserve_setup,
+	.clean	= reserve_clean,
+	.run	= reserve_run,
+};
+
+static __init void reserve_wbt_init(void)
+{
+	register_wboxtest(&wbt_reserve);
+}
+
+static __exit void reserve_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_reserve);
+}
+
+wboxtest_initcall(reserve_wbt_init);
+wboxtest_exitcall(reserve_wbt_exit);
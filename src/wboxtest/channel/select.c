@@ -0,0 +1,120 @@
+/*
+ * wboxtest/channel/select.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_select_pdata_t
+{
+	struct channel_t * c;
+	struct semaphore_t done;
+};
+
+static void select_producer(struct task_t * task, void * data)
+{
+	struct wbt_select_pdata_t * pdat = (struct wbt_select_pdata_t *)data;
+	unsigned char b = 0x5a;
+
+	task_sleep(10 * 1000 * 1000);
+	channel_send(pdat->c, &b, 1);
+	semaphore_up(&pdat->done);
+}
+
+static void * select_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_select_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_select_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->c = channel_alloc(16);
+	if(!pdat->c)
+	{
+		free(pdat);
+		return NULL;
+	}
+	semaphore_init(&pdat->done, 0);
+
+	return pdat;
+}
+
+static void select_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_select_pdata_t * pdat = (struct wbt_select_pdata_t *)data;
+
+	if(pdat)
+	{
+		channel_free(pdat->c);
+		free(pdat);
+	}
+}
+
+static void select_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_select_pdata_t * pdat = (struct wbt_select_pdata_t *)data;
+	struct channel_select_t sel;
+	struct task_t * task;
+	unsigned char buf[16];
+	ktime_t t1, t2;
+
+	if(pdat)
+	{
+		/* An empty channel is not readable, wait out the whole timeout */
+		sel.c = pdat->c;
+		sel.events = CHANNEL_EVENT_READ;
+		t1 = ktime_get();
+		assert_equal(channel_select(&sel, 1, 20 * 1000 * 1000), 0);
+		t2 = ktime_get();
+		assert_equal(sel.revents, 0);
+		assert_true(ktime_ms_delta(t2, t1) >= 20);
+
+		/* A full channel is not writable, polling returns at once */
+		memset(buf, 0, sizeof(buf));
+		channel_send(pdat->c, buf, sizeof(buf));
+		sel.events = CHANNEL_EVENT_WRITE;
+		assert_equal(channel_select(&sel, 1, 0), 0);
+		assert_equal(sel.revents, 0);
+		sel.events = CHANNEL_EVENT_READ | CHANNEL_EVENT_WRITE;
+		assert_equal(channel_select(&sel, 1, 0), 1);
+		assert_equal(sel.revents, CHANNEL_EVENT_READ);
+		channel_recv(pdat->c, buf, sizeof(buf));
+
+		/* A send from another task ends the wait before the timeout */
+		task = task_create(NULL, "wbt-select", select_producer, pdat, 0, 0);
+		assert_not_null(task);
+		if(!task)
+			return;
+		task_resume(task);
+		sel.events = CHANNEL_EVENT_READ;
+		t1 = ktime_get();
+		assert_equal(channel_select(&sel, 1, 1000 * 1000 * 1000), 1);
+		t2 = ktime_get();
+		assert_equal(sel.revents, CHANNEL_EVENT_READ);
+		assert_true(ktime_ms_delta(t2, t1) < 1000);
+		semaphore_down(&pdat->done);
+		channel_recv(pdat->c, buf, 1);
+		assert_equal(buf[0], 0x5a);
+	}
+}
+
+static struct wboxtest_t wbt_select = {
+	.group	= "channel",
+	.name	= "select",
+	.setup	= select_setup,
+	.clean	= select_clean,
+	.run	= select_run,
+};
+
+static __init void select_wbt_init(void)
+{
+	register_wboxtest(&wbt_select);
+}
+
+static __exit void select_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_select);
+}
+
+wboxtest_initcall(select_wbt_init);
+wboxtest_exitcall(select_wbt_exit);
@@ -0,0 +1,115 @@
+/*
+ * wboxtest/channel/spsc.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_spsc_pdata_t
+{
+	struct channel_t * c;
+	struct semaphore_t done;
+	unsigned char * src;
+	unsigned char * dst;
+	int len;
+};
+
+static void spsc_producer(struct task_t * task, void * data)
+{
+	struct wbt_spsc_pdata_t * pdat = (struct wbt_spsc_pdata_t *)data;
+	int l, n;
+
+	for(l = 0; l < pdat->len; l += n)
+	{
+		n = min(wboxtest_random_int(1, 37), pdat->len - l);
+		channel_send(pdat->c, pdat->src + l, n);
+	}
+	semaphore_up(&pdat->done);
+}
+
+static void * spsc_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_spsc_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_spsc_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->len = SZ_4K;
+	pdat->src = malloc(pdat->len);
+	pdat->dst = malloc(pdat->len);
+	pdat->c = channel_alloc_mode(16, CHANNEL_MODE_SPSC);
+	if(!pdat->src || !pdat->dst || !pdat->c)
+	{
+		channel_free(pdat->c);
+		free(pdat->src);
+		free(pdat->dst);
+		free(pdat);
+		return NULL;
+	}
+	semaphore_init(&pdat->done, 0);
+	wboxtest_random_buffer((char *)pdat->src, pdat->len);
+	memset(pdat->dst, 0, pdat->len);
+
+	return pdat;
+}
+
+static void spsc_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_spsc_pdata_t * pdat = (struct wbt_spsc_pdata_t *)data;
+
+	if(pdat)
+	{
+		channel_free(pdat->c);
+		free(pdat->src);
+		free(pdat->dst);
+		free(pdat);
+	}
+}
+
+static void spsc_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_spsc_pdata_t * pdat = (struct wbt_spsc_pdata_t *)data;
+	struct task_t * task;
+	int l, n;
+
+	if(pdat)
+	{
+		/*
+		 * The ring is much smaller than the data and both sides move in
+		 * odd sized pieces, so the indexes wrap many times at every offset.
+		 */
+		task = task_create(NULL, "wbt-spsc", spsc_producer, pdat, 0, 0);
+		assert_not_null(task);
+		if(!task)
+			return;
+		task_resume(task);
+		for(l = 0; l < pdat->len; l += n)
+		{
+			n = min(wboxtest_random_int(1, 29), pdat->len - l);
+			channel_recv(pdat->c, pdat->dst + l, n);
+		}
+		semaphore_down(&pdat->done);
+		assert_memory_equal(pdat->dst, pdat->src, pdat->len);
+	}
+}
+
+static struct wboxtest_t wbt_spsc = {
+	.group	= "channel",
+	.name	= "spsc",
+	.setup	= spsc_setup,
+	.clean	= spsc_clean,
+	.run	= spsc_run,
+};
+
+static __init void spsc_wbt_init(void)
+{
+	register_wboxtest(&wbt_spsc);
+}
+
+static __exit void spsc_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_spsc);
+}
+
+wboxtest_initcall(spsc_wbt_init);
+wboxtest_exitcall(spsc_wbt_exit);
@@ -0,0 +1,101 @@
+/*
+ * wboxtest/dma/dmapool.c
+ */
+
+#include <dma/dmapool.h>
+#include <wboxtest.h>
+
+struct wbt_dmapool_pdata_t
+{
+	struct dma_pool_t * pool;
+	void ** bufs;
+	int count;
+};
+
+static void * dmapool_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_dmapool_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_dmapool_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->count = wboxtest_random_int(1, 32);
+	pdat->bufs = malloc(sizeof(void *) * pdat->count);
+	pdat->pool = dma_pool_create(wboxtest_random_int(1, SZ_16K), SZ_4K, pdat->count);
+	if(!pdat->bufs || !pdat->pool)
+	{
+		dma_pool_destroy(pdat->pool);
+		free(pdat->bufs);
+		free(pdat);
+		return NULL;
+	}
+
+	return pdat;
+}
+
+static void dmapool_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_dmapool_pdata_t * pdat = (struct wbt_dmapool_pdata_t *)data;
+
+	if(pdat)
+	{
+		dma_pool_destroy(pdat->pool);
+		free(pdat->bufs);
+		free(pdat);
+	}
+}
+
+static void dmapool_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_dmapool_pdata_t * pdat = (struct wbt_dmapool_pdata_t *)data;
+	void * buf;
+	int i, j;
+
+	if(pdat)
+	{
+		for(i = 0; i < pdat->count; i++)
+		{
+			pdat->bufs[i] = dma_pool_alloc(pdat->pool);
+			assert_not_null(pdat->bufs[i]);
+			assert_true(dma_pool_contains(pdat->pool, pdat->bufs[i]));
+			assert_equal(dma_pool_to_phys(pdat->pool, pdat->bufs[i]), virt_to_phys((virtual_addr_t)pdat->bufs[i]));
+			for(j = 0; j < i; j++)
+				assert_not_equal(pdat->bufs[i], pdat->bufs[j]);
+		}
+		assert_null(dma_pool_alloc(pdat->pool));
+
+		i = wboxtest_random_int(0, pdat->count - 1);
+		dma_pool_free(pdat->pool, pdat->bufs[i]);
+		buf = dma_pool_alloc(pdat->pool);
+		assert_equal(buf, pdat->bufs[i]);
+		assert_null(dma_pool_alloc(pdat->pool));
+
+		for(i = 0; i < pdat->count; i++)
+			dma_pool_free(pdat->pool, pdat->bufs[i]);
+		for(i = 0; i < pdat->count; i++)
+			assert_not_null(dma_pool_alloc(pdat->pool));
+		assert_null(dma_pool_alloc(pdat->pool));
+	}
+}
+
+static struct wboxtest_t wbt_dmapool = {
+	.group	= "dma",
+	.name	= "dmapool",
+	.setup	= dmapool_setup,
+	.clean	= dmapool_clean,
+	.run	= dmapool_run,
+};
+
+static __init void dmapool_wbt_init(void)
+{
+	register_wboxtest(&wbt_dmapool);
+}
+
+static __exit void dmapool_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_dmapool);
+}
+
+wboxtest_initcall(dmapool_wbt_init);
+wboxtest_exitcall(dmapool_wbt_exit);